@@ -6,6 +6,8 @@
  * approach. It provides:
  * - Character device interface for reading temperature samples
  * - poll/epoll support for event-driven reading
+ * - mmap() of the sample ring for zero-copy consumers
+ * - Playback of user-supplied traces through write() or request_firmware()
  * - sysfs interface for configuration
  * - ioctl interface for batch operations
  * - Device Tree binding support
@@ -23,446 +25,3153 @@
 #include <linux/atomic.h>
 #include <linux/fs.h>
 #include <linux/random.h>
+#include <linux/prandom.h>
+#include <linux/reciprocal_div.h>
+#include <linux/math64.h>
 #include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/hrtimer.h>
 #include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
 #include <linux/jiffies.h>
-#include <linux/kfifo.h>
 #include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/version.h>
+#include <linux/rculist.h>
+#include <linux/log2.h>
+#include <linux/firmware.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/eventfd.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
 
 #include "nxp_simtemp.h"
 #include "nxp_simtemp_ioctl.h"
 
+#define CREATE_TRACE_POINTS
+#include "nxp_simtemp_trace.h"
+
 MODULE_AUTHOR("Armando Mares");
 MODULE_DESCRIPTION("NXP Simulated Temperature Sensor Driver");
 MODULE_LICENSE("GPL v2");
 MODULE_VERSION("1.0.0");
 
-/* Global variables */
-static struct simtemp_device *g_simtemp_dev;
+/* Allocates the N in /dev/simtemp<N> */
+static DEFINE_IDA(simtemp_ida);
+
+/* /sys/kernel/debug/simtemp, one directory per device below it */
+static struct dentry *simtemp_debugfs_root;
+
+static unsigned int nr_devices = 1;
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices,
+		 "Simulated sensors to create besides DT ones (0-"
+		 __stringify(SIMTEMP_MAX_DEVICES) ", default 1)");
+
+/* Instance defaults, overridden per node by timer-slack-us / timer-align */
+static unsigned int timer_slack_us;
+module_param(timer_slack_us, uint, 0444);
+MODULE_PARM_DESC(timer_slack_us,
+		 "Default timer slack in microseconds (0-"
+		 __stringify(SIMTEMP_MAX_TIMER_SLACK_US) ", default 0)");
+
+static bool timer_align;
+module_param(timer_align, bool, 0444);
+MODULE_PARM_DESC(timer_align,
+		 "Align instance timers to a shared period grid (default N)");
+
+static const char *const simtemp_mode_names[] = {
+	[SIMTEMP_MODE_NORMAL] = "normal",
+	[SIMTEMP_MODE_NOISY] = "noisy",
+	[SIMTEMP_MODE_RAMP] = "ramp",
+	[SIMTEMP_MODE_REPLAY] = "replay",
+};
+
+static const char *const simtemp_overflow_names[] = {
+	[SIMTEMP_OVERFLOW_OVERWRITE_OLDEST] = "overwrite-oldest",
+	[SIMTEMP_OVERFLOW_DROP_NEWEST] = "drop-newest",
+};
+
+static const char *const simtemp_context_names[] = {
+	[SIMTEMP_CONTEXT_HRTIMER] = "hrtimer",
+	[SIMTEMP_CONTEXT_WORKQUEUE] = "workqueue",
+};
+
+static const char *const simtemp_filter_names[] = {
+	[SIMTEMP_FILTER_NONE] = "none",
+	[SIMTEMP_FILTER_DECIMATE] = "decimate",
+	[SIMTEMP_FILTER_BOXCAR] = "boxcar",
+	[SIMTEMP_FILTER_EMA] = "ema",
+	[SIMTEMP_FILTER_MINMAX] = "minmax",
+};
+
+/*
+ * One period of each mode's waveform in milli-degrees, built at module
+ * load so the producer only does a table lookup per sample. NOISY shares
+ * the NORMAL curve and adds noise on top; REPLAY reads the user's trace.
+ */
+struct simtemp_wave {
+	u32 len;
+	s32 mC[SIMTEMP_WAVE_MAX_LEN];
+};
+
+static struct simtemp_wave simtemp_waves[SIMTEMP_MODE_MAX] __ro_after_init;
 
-static s32 simtemp_get_base_temperature(struct simtemp_device *simtemp)
+/* Piecewise-linear sine of 'angle' in milliradians, scaled to +-1000 */
+static int simtemp_sine_approx(int angle)
 {
-	static unsigned long counter;
-	s32 temp;
-	int angle, sine_approx;
-
-	switch (simtemp->mode) {
-	case SIMTEMP_MODE_NORMAL:
-		/* Simple sine wave around base temperature using integer math */
-		/* Approximate sine using linear interpolation */
-		angle = (counter * 314) % 6280; /* 0 to 2*pi*1000 */
-		if (angle < 1570) /* 0 to pi/2 */
-			sine_approx = (angle * 1000) / 1570;
-		else if (angle < 4710) /* pi/2 to 3*pi/2 */
-			sine_approx = 1000 - ((angle - 1570) * 1000) / 1570;
-		else /* 3*pi/2 to 2*pi */
-			sine_approx = -((angle - 4710) * 1000) / 1570;
-		temp = SIMTEMP_BASE_TEMP_MC +
-		       (SIMTEMP_TEMP_RANGE_MC * sine_approx) / 1000;
-		break;
+	if (angle < 1570) /* 0 to pi/2 */
+		return (angle * 1000) / 1570;
+	if (angle < 4710) /* pi/2 to 3*pi/2 */
+		return 1000 - ((angle - 1570) * 1000) / 1570;
+	/* 3*pi/2 to 2*pi */
+	return -1000 + ((angle - 4710) * 1000) / 1570;
+}
 
-	case SIMTEMP_MODE_NOISY: {
-		/* Normal mode with added noise */
-		angle = (counter * 314) % 6280;
-		if (angle < 1570)
-			sine_approx = (angle * 1000) / 1570;
-		else if (angle < 4710)
-			sine_approx = 1000 - ((angle - 1570) * 1000) / 1570;
-		else
-			sine_approx = -((angle - 4710) * 1000) / 1570;
-		temp = SIMTEMP_BASE_TEMP_MC +
-		       (SIMTEMP_TEMP_RANGE_MC * sine_approx) / 1000;
-		temp += (get_random_u32() % SIMTEMP_NOISE_RANGE_MC) -
-			(SIMTEMP_NOISE_RANGE_MC / 2);
-	} break;
-
-	case SIMTEMP_MODE_RAMP: {
-		/* Linear ramp up and down */
-		temp = SIMTEMP_BASE_TEMP_MC +
-		       ((counter % 200) < 100 ? ((counter % 100) *
-						 SIMTEMP_TEMP_RANGE_MC / 100) :
-						(((200 - (counter % 200)) *
-						  SIMTEMP_TEMP_RANGE_MC) /
-						 100));
-		break;
+static void __init simtemp_build_waves(void)
+{
+	struct simtemp_wave *sine = &simtemp_waves[SIMTEMP_MODE_NORMAL];
+	struct simtemp_wave *ramp = &simtemp_waves[SIMTEMP_MODE_RAMP];
+	int i;
+
+	/* 0.314 rad per sample: 20 samples per period */
+	sine->len = SIMTEMP_SINE_STEPS;
+	for (i = 0; i < sine->len; i++)
+		sine->mC[i] = SIMTEMP_BASE_TEMP_MC +
+			      (SIMTEMP_TEMP_RANGE_MC *
+			       simtemp_sine_approx(i * 314)) / 1000;
+
+	simtemp_waves[SIMTEMP_MODE_NOISY] = *sine;
+
+	/* Linear ramp up and back down */
+	ramp->len = SIMTEMP_RAMP_STEPS;
+	for (i = 0; i < ramp->len; i++)
+		ramp->mC[i] = SIMTEMP_BASE_TEMP_MC +
+			      (i < ramp->len / 2 ? i : ramp->len - i) *
+				      SIMTEMP_TEMP_RANGE_MC / (ramp->len / 2);
+}
+
+static struct simtemp_trace *simtemp_trace_alloc(u32 capacity)
+{
+	struct simtemp_trace *trace;
+
+	/* Traces run to megabytes: kvzalloc() falls back to vmalloc */
+	trace = kvzalloc(struct_size(trace, mC, capacity), GFP_KERNEL);
+	if (trace)
+		trace->capacity = capacity;
+
+	return trace;
+}
+
+/*
+ * Make room for 'need' entries in an upload. Growth is geometric, so a
+ * trace written in small chunks costs a few allocations and copies in
+ * total rather than one per write.
+ */
+static struct simtemp_trace *simtemp_trace_grow(struct simtemp_trace *old,
+						u32 need)
+{
+	u32 capacity = old ? old->capacity : SIMTEMP_MIN_TRACE_LEN;
+	struct simtemp_trace *trace;
+
+	while (capacity < need)
+		capacity = min(capacity * 2, SIMTEMP_MAX_TRACE_LEN);
+
+	trace = simtemp_trace_alloc(capacity);
+	if (!trace)
+		return NULL;
+
+	if (old) {
+		memcpy(trace->mC, old->mC, old->len * sizeof(s32));
+		trace->len = old->len;
+		kvfree(old);
 	}
 
-	default:
-		temp = SIMTEMP_BASE_TEMP_MC;
-		break;
+	return trace;
+}
+
+/* Publish 'trace' as the replay source; playback restarts at its top */
+static void simtemp_trace_install(struct simtemp_device *simtemp,
+				  struct simtemp_trace *trace)
+{
+	struct simtemp_trace *old;
+
+	mutex_lock(&simtemp->config_lock);
+	old = rcu_replace_pointer(simtemp->trace, trace,
+				  lockdep_is_held(&simtemp->config_lock));
+	WRITE_ONCE(simtemp->replay_rewind, true);
+	mutex_unlock(&simtemp->config_lock);
+
+	/* The producer may still be reading the old one */
+	if (old)
+		kvfree_rcu(old, rcu);
+
+	simtemp_info(simtemp, "Replay trace loaded: %u samples\n", trace->len);
+}
+
+/*
+ * Next entry of the replay trace, or false once a one-shot replay has
+ * played its last one. Producer only.
+ */
+static bool simtemp_replay_next(struct simtemp_device *simtemp,
+				const struct simtemp_params *p, s32 *temp)
+{
+	const struct simtemp_trace *trace;
+	u32 pos = simtemp->replay_pos;
+	bool more = false;
+
+	if (READ_ONCE(simtemp->replay_rewind)) {
+		WRITE_ONCE(simtemp->replay_rewind, false);
+		pos = 0;
 	}
-	counter++;
-	return temp;
+
+	rcu_read_lock();
+	trace = rcu_dereference(simtemp->trace);
+	if (trace) {
+		if (pos >= trace->len && p->replay_loop)
+			pos = 0;
+		if (pos < trace->len) {
+			*temp = trace->mC[pos++];
+			more = true;
+		}
+	}
+	rcu_read_unlock();
+
+	simtemp->replay_pos = pos;
+	return more;
 }
 
-int simtemp_generate_sample(struct simtemp_device *simtemp)
+/* Returns false when the mode has nothing left to produce */
+static bool simtemp_get_base_temperature(struct simtemp_device *simtemp,
+					 const struct simtemp_params *p,
+					 s32 *temp)
 {
-	struct simtemp_sample sample;
-	unsigned long flags;
-	bool threshold_event = false;
-	int ret;
+	enum simtemp_mode mode = p->mode;
+	const struct simtemp_wave *wave;
+	u32 phase = simtemp->wave_phase;
 
-	if (!simtemp->enabled)
-		return 0;
+	if (mode == SIMTEMP_MODE_REPLAY)
+		return simtemp_replay_next(simtemp, p, temp);
+
+	if (mode >= SIMTEMP_MODE_MAX) {
+		*temp = SIMTEMP_BASE_TEMP_MC;
+		return true;
+	}
+
+	/* Wrap by compare; also absorbs a switch to a shorter table */
+	wave = &simtemp_waves[mode];
+	if (phase >= wave->len)
+		phase = 0;
+	*temp = wave->mC[phase];
+	simtemp->wave_phase = phase + 1;
 
-	sample.timestamp_ns = ktime_get_ns();
-	sample.temp_mC = simtemp_get_base_temperature(simtemp);
-	sample.flags = SIMTEMP_FLAG_NEW_SAMPLE;
+	if (mode == SIMTEMP_MODE_NOISY)
+		*temp += reciprocal_scale(prandom_u32_state(&simtemp->rnd),
+					  SIMTEMP_NOISE_RANGE_MC) -
+			 (SIMTEMP_NOISE_RANGE_MC / 2);
 
-	if ((simtemp->last_temp_mC < simtemp->threshold_mC &&
-	     sample.temp_mC >= simtemp->threshold_mC) ||
-	    (simtemp->last_temp_mC >= simtemp->threshold_mC &&
-	     sample.temp_mC < simtemp->threshold_mC)) {
-		sample.flags |= SIMTEMP_FLAG_THRESHOLD_CROSSED;
-		threshold_event = true;
-		simtemp->stats.alerts++;
+	return true;
+}
+
+/*
+ * Concurrency model of the sample ring
+ *
+ * Producer: exactly one context ever writes the ring. In hrtimer mode it
+ * is the timer callback, which never runs concurrently with itself; in
+ * workqueue mode it is sample_work, which the workqueue never runs on two
+ * CPUs at once. The mode only changes while sampling is stopped and the
+ * work item has been flushed, so the two are never live together. The
+ * producer owns 'head', 'tail' and the slots and needs no lock, so no
+ * interrupts are disabled on the hot path.
+ *
+ * Consumers: every open file has a private cursor guarded by its own
+ * reader->lock (read(), FLUSH_READER and GET_READER_STATS). They never
+ * write shared ring state, so flushing one reader cannot race the producer
+ * or another reader. mmap() consumers keep their cursor in user space.
+ * Only a device-wide flush moves 'tail', with sampling stopped.
+ *
+ * Ordering: the producer writes a slot and then publishes it with
+ * smp_store_release() of 'head'; consumers load 'head' with
+ * smp_load_acquire() before copying. A slot can be recycled while it is
+ * being copied, so after the copy consumers re-read 'head' behind an
+ * smp_rmb(), pairing with the producer's smp_wmb() ahead of each slot
+ * write, and discard anything that may have been overwritten.
+ *
+ * Lifetime: the ring itself is published through RCU. A resize (which
+ * requires sampling to be stopped) swaps in a new ring and frees the old
+ * one after a grace period; readers notice through the generation number.
+ */
+static struct simtemp_ring *simtemp_ring_alloc(u32 capacity, u32 generation)
+{
+	size_t data_size = PAGE_ALIGN(capacity * sizeof(struct simtemp_sample));
+	struct simtemp_ring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return NULL;
+
+	/* vmalloc_user() rather than kvmalloc(): the area must be mappable */
+	ring->size = PAGE_SIZE + data_size;
+	ring->hdr = vmalloc_user(ring->size);
+	if (!ring->hdr) {
+		kfree(ring);
+		return NULL;
 	}
 
-	simtemp->last_temp_mC = sample.temp_mC;
+	ring->slots = (struct simtemp_sample *)((u8 *)ring->hdr + PAGE_SIZE);
+	ring->capacity = capacity;
+	ring->mask = capacity - 1;
+	ring->generation = generation;
 
-	spin_lock_irqsave(&simtemp->buffer_lock, flags);
-	ret = kfifo_put(&simtemp->sample_buffer, sample);
-	spin_unlock_irqrestore(&simtemp->buffer_lock, flags);
+	ring->hdr->version = SIMTEMP_RING_VERSION;
+	ring->hdr->capacity = capacity;
+	ring->hdr->data_offset = PAGE_SIZE;
+	ring->hdr->sample_size = sizeof(struct simtemp_sample);
 
-	if (!ret) {
-		simtemp->stats.last_error = -EOVERFLOW;
-		simtemp_warn(simtemp, "Sample buffer overflow\n");
-	} else {
-		simtemp->stats.updates++;
+	return ring;
+}
+
+static void simtemp_ring_free(struct simtemp_ring *ring)
+{
+	if (!ring)
+		return;
+
+	vfree(ring->hdr);
+	kfree(ring);
+}
+
+/*
+ * Replace the ring with an empty one of 'capacity' slots. Caller holds
+ * config_lock with sampling stopped; readers pick up the new ring through
+ * RCU and restart at its first slot.
+ */
+static int simtemp_ring_resize(struct simtemp_device *simtemp, u32 capacity)
+{
+	struct simtemp_ring *old, *ring;
+	int ret = 0;
+
+	if (!is_power_of_2(capacity) || capacity < SIMTEMP_MIN_BUFFER_SIZE ||
+	    capacity > SIMTEMP_MAX_BUFFER_SIZE)
+		return -EINVAL;
+
+	if (simtemp->enabled)
+		return -EBUSY;
+
+	/* The work item may still be finishing the last tick */
+	cancel_work_sync(&simtemp->sample_work);
+
+	mutex_lock(&simtemp->ring_lock);
+
+	/* Existing mappings would keep looking at the old pages */
+	if (atomic_read(&simtemp->ring_maps)) {
+		ret = -EBUSY;
+		goto out_unlock;
 	}
 
-	wake_up_interruptible(&simtemp->wait_queue);
+	old = rcu_dereference_protected(simtemp->ring,
+					lockdep_is_held(&simtemp->ring_lock));
+	if (old->capacity == capacity)
+		goto out_unlock;
 
-	simtemp_dbg(simtemp, "Generated sample: temp=%d.%03d°C, flags=0x%x\n",
-		    sample.temp_mC / 1000, abs(sample.temp_mC % 1000),
-		    sample.flags);
+	ring = simtemp_ring_alloc(capacity, old->generation + 1);
+	if (!ring) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	/* Sampling is stopped, so the latest slot is stable */
+	ring->hdr->latest = old->hdr->latest;
+	ring->hdr->latest_seq = old->hdr->latest_seq;
+	ring->resync_head = old->head;
+
+	rcu_assign_pointer(simtemp->ring, ring);
+	mutex_unlock(&simtemp->ring_lock);
+
+	synchronize_rcu();
+	simtemp_ring_free(old);
 
+	simtemp_info(simtemp, "Sample buffer resized to %u entries\n",
+		     capacity);
 	return 0;
+
+out_unlock:
+	mutex_unlock(&simtemp->ring_lock);
+	return ret;
 }
 
-void simtemp_sample_work(struct work_struct *work)
+/*
+ * Drop everything queued, for every reader at once: as after a resize, the
+ * generation bump sends each cursor to the tail on its next access, and
+ * the tail is now the head. What a reader had not read yet counts as its
+ * overrun. Mapped consumers see the tail move past their cursor. Caller
+ * holds config_lock with sampling stopped.
+ */
+static void simtemp_ring_flush(struct simtemp_device *simtemp)
 {
-	struct simtemp_device *simtemp =
-		container_of(work, struct simtemp_device, sample_work);
+	struct simtemp_ring *ring = rcu_dereference_protected(
+		simtemp->ring, lockdep_is_held(&simtemp->config_lock));
+
+	ring->resync_head = ring->head;
+	WRITE_ONCE(ring->tail, ring->head);
+	WRITE_ONCE(ring->hdr->tail, ring->head);
+	/*
+	 * The new tail must be visible before cursors are sent to it; pairs
+	 * with the acquire in the readers' generation snapshot
+	 */
+	smp_store_release(&ring->generation, ring->generation + 1);
+}
 
-	simtemp_generate_sample(simtemp);
+/* Number of samples currently held by the ring */
+static u32 simtemp_ring_count(struct simtemp_ring *ring)
+{
+	return smp_load_acquire(&ring->head) - READ_ONCE(ring->tail);
 }
 
-enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer)
+/*
+ * Producer context only, with the overflow policy already applied.
+ * Once the ring is full the oldest slot is recycled and readers that had
+ * not consumed it yet account the loss as an overrun.
+ */
+static void simtemp_ring_push(struct simtemp_ring *ring,
+			      const struct simtemp_sample *sample)
 {
-	struct simtemp_device *simtemp =
-		container_of(timer, struct simtemp_device, timer);
+	u32 head = ring->head;
 
-	schedule_work(&simtemp->sample_work);
+	if (head - ring->tail == ring->capacity) {
+		WRITE_ONCE(ring->tail, ring->tail + 1);
+		WRITE_ONCE(ring->hdr->tail, ring->tail);
+	}
 
-	if (simtemp->enabled) {
-		hrtimer_forward_now(timer, ms_to_ktime(simtemp->sampling_ms));
-		return HRTIMER_RESTART;
+	/*
+	 * Order the previous head update before the slot is overwritten.
+	 * Pairs with smp_rmb() in simtemp_reader_fetch().
+	 */
+	smp_wmb();
+	ring->slots[head & ring->mask] = *sample;
+
+	/* Publish the slot before the new head becomes visible */
+	smp_store_release(&ring->head, head + 1);
+	smp_store_release(&ring->hdr->head, head + 1);
+
+	/* Never ahead of 'head' for a reader that loads it first */
+	if (sample->flags & SIMTEMP_FLAG_THRESHOLD_CROSSED)
+		smp_store_release(&ring->last_event, head + 1);
+}
+
+/*
+ * Publish the newest generated sample in the header's seqcount-guarded
+ * slot. Producer only; preemption is off so a reader spinning on an odd
+ * sequence never waits on a preempted writer.
+ */
+static void simtemp_ring_publish_latest(struct simtemp_ring *ring,
+					const struct simtemp_sample *sample)
+{
+	struct simtemp_ring_header *hdr = ring->hdr;
+	u32 seq = hdr->latest_seq;
+
+	preempt_disable();
+	WRITE_ONCE(hdr->latest_seq, seq + 1);
+	smp_wmb();
+	hdr->latest = *sample;
+	/* Pairs with smp_rmb() in simtemp_get_latest() */
+	smp_wmb();
+	WRITE_ONCE(hdr->latest_seq, seq + 2);
+	preempt_enable();
+}
+
+/* Newest generated sample, without touching any cursor */
+static int simtemp_get_latest(struct simtemp_device *simtemp,
+			      struct simtemp_sample *sample)
+{
+	struct simtemp_ring_header *hdr;
+	u32 seq;
+
+	rcu_read_lock();
+	hdr = rcu_dereference(simtemp->ring)->hdr;
+	do {
+		seq = smp_load_acquire(&hdr->latest_seq);
+		if (seq & 1) {
+			cpu_relax();
+			continue;
+		}
+		*sample = hdr->latest;
+		smp_rmb();
+	} while ((seq & 1) || READ_ONCE(hdr->latest_seq) != seq);
+	rcu_read_unlock();
+
+	return seq ? 0 : -ENODATA;
+}
+
+/*
+ * The reader's cursor into 'ring' as of generation 'gen', which the caller
+ * loaded with smp_load_acquire(). A cursor left over from a ring that has
+ * since been replaced or flushed restarts at the oldest sample.
+ */
+static u32 __simtemp_reader_cursor(struct simtemp_reader *reader,
+				   struct simtemp_ring *ring, u32 gen)
+{
+	if (READ_ONCE(reader->ring_gen) != gen)
+		return READ_ONCE(ring->tail);
+
+	return READ_ONCE(reader->cursor);
+}
+
+static u32 simtemp_reader_cursor(struct simtemp_reader *reader,
+				 struct simtemp_ring *ring)
+{
+	return __simtemp_reader_cursor(reader, ring,
+				       smp_load_acquire(&ring->generation));
+}
+
+/* Samples queued for the reader, capped at what the ring can hold */
+static u32 simtemp_reader_backlog(struct simtemp_reader *reader,
+				  struct simtemp_ring *ring)
+{
+	return min(smp_load_acquire(&ring->head) -
+			   simtemp_reader_cursor(reader, ring),
+		   ring->capacity);
+}
+
+/*
+ * How far the slowest read() consumer trails the head. Files that never
+ * read, mmap() consumers whose cursor the driver cannot see, and
+ * event-only readers that skip most samples anyway do not hold the
+ * producer back. Caller holds rcu_read_lock().
+ */
+static u32 simtemp_ring_lag(struct simtemp_device *simtemp,
+			    struct simtemp_ring *ring)
+{
+	struct simtemp_reader *reader;
+	u32 head = ring->head, lag = 0;
+
+	list_for_each_entry_rcu(reader, &simtemp->readers, node) {
+		if (!READ_ONCE(reader->streaming) || READ_ONCE(reader->mapped) ||
+		    READ_ONCE(reader->events_only))
+			continue;
+
+		lag = max(lag, head - simtemp_reader_cursor(reader, ring));
 	}
 
-	return HRTIMER_NORESTART;
+	return lag;
 }
 
-static int simtemp_open(struct inode *inode, struct file *file)
+static bool simtemp_reader_pending(struct simtemp_reader *reader)
 {
-	struct simtemp_device *simtemp = container_of(
-		file->private_data, struct simtemp_device, misc_dev);
+	struct simtemp_ring *ring;
+	bool pending;
 
-	if (atomic_inc_return(&simtemp->open_count) == 1)
-		simtemp_info(simtemp, "Device opened\n");
+	rcu_read_lock();
+	ring = rcu_dereference(reader->simtemp->ring);
+	pending = simtemp_reader_backlog(reader, ring) != 0;
+	rcu_read_unlock();
 
-	file->private_data = simtemp;
-	return 0;
+	return pending;
 }
 
-static int simtemp_release(struct inode *inode, struct file *file)
+/*
+ * A reader is ready once its watermark is reached, once the oldest sample
+ * it has queued is older than its latency limit, or as soon as anything is
+ * queued while the device is stopped (no further samples would come).
+ * Caller holds rcu_read_lock().
+ */
+static bool __simtemp_reader_ready(struct simtemp_reader *reader,
+				   struct simtemp_ring *ring, u64 now)
 {
-	struct simtemp_device *simtemp = file->private_data;
+	u32 cursor = simtemp_reader_cursor(reader, ring);
+	u32 event = smp_load_acquire(&ring->last_event);
+	u32 backlog = smp_load_acquire(&ring->head) - cursor;
+	u32 timeout_ms;
 
-	if (atomic_dec_return(&simtemp->open_count) == 0)
-		simtemp_info(simtemp, "Device closed\n");
+	/* Only a crossing at or past the cursor, i.e. event in (cursor, head] */
+	if (READ_ONCE(reader->events_only))
+		return event - cursor - 1 < backlog;
 
-	return 0;
+	if (!backlog)
+		return false;
+
+	if (backlog >= min(READ_ONCE(reader->watermark), ring->capacity) ||
+	    !READ_ONCE(reader->simtemp->enabled))
+		return true;
+
+	timeout_ms = READ_ONCE(reader->timeout_ms);
+	if (!timeout_ms)
+		return false;
+
+	return now - ring->slots[cursor & ring->mask].timestamp_ns >=
+	       (u64)timeout_ms * NSEC_PER_MSEC;
 }
 
-static __poll_t simtemp_poll(struct file *file, struct poll_table_struct *wait)
+static bool simtemp_reader_ready(struct simtemp_reader *reader, u64 now)
 {
-	struct simtemp_device *simtemp = file->private_data;
-	__poll_t mask = 0;
+	bool ready;
 
-	simtemp->stats.poll_calls++;
+	rcu_read_lock();
+	ready = __simtemp_reader_ready(
+		reader, rcu_dereference(reader->simtemp->ring), now);
+	rcu_read_unlock();
 
-	poll_wait(file, &simtemp->wait_queue, wait);
+	return ready;
+}
 
-	if (!kfifo_is_empty(&simtemp->sample_buffer))
-		mask |= EPOLLIN | EPOLLRDNORM;
+/*
+ * Wake only the readers whose wakeup condition holds, so a batch consumer
+ * sleeping on a large watermark is not scheduled for every sample.
+ */
+static void simtemp_wake_readers(struct simtemp_device *simtemp, u64 now)
+{
+	struct simtemp_reader *reader;
+	struct simtemp_ring *ring;
+	u32 woken = 0;
+
+	rcu_read_lock();
+	ring = rcu_dereference(simtemp->ring);
+	list_for_each_entry_rcu(reader, &simtemp->readers, node) {
+		/*
+		 * Keyed, so epoll entries that only asked for EPOLLPRI sleep
+		 * through the stream they never drain
+		 */
+		if (wq_has_sleeper(&reader->wait) &&
+		    __simtemp_reader_ready(reader, ring, now)) {
+			wake_up_interruptible_poll(&reader->wait,
+						   EPOLLIN | EPOLLRDNORM);
+			woken++;
+		}
+	}
+	if (woken)
+		trace_simtemp_wakeup(simtemp->id, ring->head, woken);
+	rcu_read_unlock();
+}
 
-	return mask;
+static void simtemp_eventfd_signal(struct eventfd_ctx *efd)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	eventfd_signal(efd);
+#else
+	eventfd_signal(efd, 1);
+#endif
 }
 
-static ssize_t simtemp_read(struct file *file, char __user *buf, size_t count,
-			    loff_t *ppos)
+/*
+ * New threshold crossings: tick every registered eventfd and wake poll()
+ * waiters with the EPOLLPRI key. Data-ready wakeups carry EPOLLIN, so an
+ * EPOLLIN-only epoll entry sleeps through alerts and an EPOLLPRI-only one
+ * through samples. Whatever the filter or overflow policy did to the
+ * samples themselves, the alert is delivered.
+ */
+static void simtemp_notify_alert(struct simtemp_device *simtemp)
 {
-	struct simtemp_device *simtemp = file->private_data;
-	struct simtemp_sample sample;
-	unsigned long flags;
-	int ret;
+	struct simtemp_reader *reader;
+	struct eventfd_ctx *efd;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(reader, &simtemp->readers, node) {
+		efd = rcu_dereference(reader->alert_efd);
+		if (efd)
+			simtemp_eventfd_signal(efd);
+		if (wq_has_sleeper(&reader->wait))
+			wake_up_interruptible_poll(&reader->wait, EPOLLPRI);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Snapshot up to 'max' samples into the reader's bounce buffer. The
+ * producer may lap a slow reader at any point, so the copy is validated
+ * against the head afterwards: any slot the producer could have been
+ * rewriting meanwhile is discarded. The fetch is described in 'f' and
+ * only committed to the reader once the samples reached user space.
+ */
+static u32 simtemp_reader_fetch(struct simtemp_reader *reader, u32 max,
+				struct simtemp_fetch *f)
+{
+	struct simtemp_ring *ring;
+	u32 cursor, head, valid_from, idx, first, n;
+
+	rcu_read_lock();
+	ring = rcu_dereference(reader->simtemp->ring);
+	/* One snapshot: the cursor and the commit must agree on the ring */
+	f->generation = smp_load_acquire(&ring->generation);
+	cursor = __simtemp_reader_cursor(reader, ring, f->generation);
+
+	f->lost = 0;
+	f->skip = 0;
+
+	/*
+	 * Coming from the generation just before, the cursor says how much
+	 * the flush or resize threw away unread. A new file's sentinel only
+	 * matches against the probe-time ring, where this comes out as zero.
+	 */
+	if (READ_ONCE(reader->ring_gen) + 1 == f->generation)
+		f->lost = ring->resync_head - READ_ONCE(reader->cursor);
+
+	head = smp_load_acquire(&ring->head);
+	if (head - cursor > ring->capacity) {
+		f->lost += head - cursor - ring->capacity;
+		cursor = head - ring->capacity;
+	}
 
-	simtemp->stats.read_calls++;
+	n = min3(head - cursor, max, (u32)SIMTEMP_READ_CHUNK);
+	idx = cursor & ring->mask;
+	first = min(n, ring->capacity - idx);
 
-	if (count < sizeof(struct simtemp_sample))
-		return -EINVAL;
+	memcpy(reader->bounce, &ring->slots[idx],
+	       first * sizeof(struct simtemp_sample));
+	memcpy(reader->bounce + first, ring->slots,
+	       (n - first) * sizeof(struct simtemp_sample));
 
-	if (kfifo_is_empty(&simtemp->sample_buffer)) {
-		if (file->f_flags & O_NONBLOCK)
-			return -EAGAIN;
+	/* Pairs with smp_wmb() in simtemp_ring_push() */
+	smp_rmb();
 
-		ret = wait_event_interruptible(
-			simtemp->wait_queue,
-			!kfifo_is_empty(&simtemp->sample_buffer));
-		if (ret)
-			return ret;
+	/* The slot at 'head' may be mid-write, recycling head - capacity */
+	head = READ_ONCE(ring->head);
+	valid_from = head + 1 - ring->capacity;
+	if ((s32)(valid_from - cursor) > 0)
+		f->skip = min(valid_from - cursor, n);
+
+	rcu_read_unlock();
+
+	f->cursor = cursor + n;
+
+	return n;
+}
+
+/*
+ * Compact up to 'max' threshold crossings of a fetch to the front of its
+ * valid bounce entries and pull the cursor back to just past the last one
+ * taken, so crossings beyond 'max' are left for the next read().
+ */
+static u32 simtemp_reader_events(struct simtemp_reader *reader,
+				 struct simtemp_fetch *f, u32 n, u32 max)
+{
+	u32 i, kept = 0;
+
+	for (i = f->skip; i < n && kept < max; i++) {
+		if (reader->bounce[i].flags & SIMTEMP_FLAG_THRESHOLD_CROSSED)
+			reader->bounce[f->skip + kept++] = reader->bounce[i];
 	}
 
-	spin_lock_irqsave(&simtemp->buffer_lock, flags);
-	ret = kfifo_get(&simtemp->sample_buffer, &sample);
-	spin_unlock_irqrestore(&simtemp->buffer_lock, flags);
+	f->cursor -= n - i;
+	return kept;
+}
 
-	if (!ret)
-		return -EAGAIN;
+/*
+ * Replay pace: replay_us when set, else the normal sampling period. Only
+ * the pace of the trace changes; sampling_us keeps its value.
+ */
+static u32 simtemp_sample_us(const struct simtemp_params *p)
+{
+	if (p->mode == SIMTEMP_MODE_REPLAY && p->replay_us)
+		return p->replay_us;
+
+	return p->sampling_us;
+}
+
+/* Nominal spacing of the samples that reach the ring */
+static u32 simtemp_output_period_ns(const struct simtemp_params *p)
+{
+	u64 period = (u64)simtemp_sample_us(p) * NSEC_PER_USEC;
+
+	if (p->filter != SIMTEMP_FILTER_NONE && p->filter_window > 1) {
+		period *= p->filter_window;
+		/* Two samples per window */
+		if (p->filter == SIMTEMP_FILTER_MINMAX)
+			period /= 2;
+	}
+
+	return min_t(u64, period, U32_MAX);
+}
+
+/*
+ * Encode 'n' samples into the compact staging buffer, using at most
+ * 'space' bytes of it. Returns how many were encoded and their size in
+ * '*len'; the rest did not fit and are the caller's to give back.
+ */
+static u32 simtemp_compact_encode(struct simtemp_compact_state *cs,
+				  const struct simtemp_sample *s, u32 n,
+				  u32 period_ns, size_t space, size_t *len)
+{
+	struct simtemp_compact_record rec;
+	struct simtemp_compact_sync sync;
+	size_t pos = 0, room = min_t(size_t, space, PAGE_SIZE);
+	s64 dtemp, drift_us;
+	u32 i;
+
+	if (period_ns != cs->period_ns)
+		cs->resync = true;
+
+	for (i = 0; i < n; i++) {
+		dtemp = (s64)s[i].temp_mC - cs->temp_mC;
+		drift_us = (s64)(s[i].timestamp_ns - cs->timestamp_ns -
+				 cs->period_ns);
+		drift_us = div_s64(drift_us + (drift_us < 0 ? -500 : 500),
+				   NSEC_PER_USEC);
+
+		if (cs->resync || s[i].flags & SIMTEMP_FLAG_OVERRUN ||
+		    cs->records >= SIMTEMP_COMPACT_SYNC_INTERVAL ||
+		    dtemp <= SIMTEMP_COMPACT_SYNC || dtemp > S16_MAX ||
+		    drift_us < -(1 << (15 - SIMTEMP_COMPACT_SHIFT)) ||
+		    drift_us >= 1 << (15 - SIMTEMP_COMPACT_SHIFT)) {
+			if (room - pos < sizeof(sync))
+				break;
+
+			sync.marker = SIMTEMP_COMPACT_SYNC;
+			sync.flags = s[i].flags;
+			sync.period_ns = period_ns;
+			sync.timestamp_ns = s[i].timestamp_ns;
+			sync.temp_mC = s[i].temp_mC;
+			memcpy(cs->buf + pos, &sync, sizeof(sync));
+			pos += sizeof(sync);
+
+			cs->timestamp_ns = s[i].timestamp_ns;
+			cs->period_ns = period_ns;
+			cs->records = 0;
+			cs->resync = false;
+		} else {
+			if (room - pos < sizeof(rec))
+				break;
+
+			rec.dtemp_mC = dtemp;
+			rec.info = (u16)((u16)drift_us << SIMTEMP_COMPACT_SHIFT) |
+				   (s[i].flags & SIMTEMP_COMPACT_FLAGS);
+			memcpy(cs->buf + pos, &rec, sizeof(rec));
+			pos += sizeof(rec);
+
+			cs->timestamp_ns += cs->period_ns +
+					    drift_us * NSEC_PER_USEC;
+			cs->records++;
+		}
+
+		cs->temp_mC = s[i].temp_mC;
+	}
+
+	*len = pos;
+	return i;
+}
+
+/*
+ * Caller holds reader->lock; returns the number of bytes copied to 'to',
+ * which for an event-only reader may be 0 while samples were consumed.
+ * A 'compact' pass needs room for a sync frame.
+ */
+static ssize_t simtemp_reader_copy(struct simtemp_reader *reader,
+				   struct iov_iter *to, bool compact)
+{
+	struct simtemp_device *simtemp = reader->simtemp;
+	struct simtemp_ring *ring;
+	const void *src;
+	struct simtemp_fetch f;
+	u32 n, max, valid, lost, seq, i, period_ns;
+	size_t len, space = iov_iter_count(to);
+	u64 now;
+
+	/*
+	 * Fetch no more than could fit: every crossing an event-only reader
+	 * keeps may need a sync frame, while a streaming one gives back
+	 * whatever the encoder could not fit.
+	 */
+	if (!compact)
+		max = min_t(size_t, space / sizeof(struct simtemp_sample),
+			    U32_MAX);
+	else if (reader->events_only)
+		max = min_t(size_t, space, PAGE_SIZE) /
+		      sizeof(struct simtemp_compact_sync);
+	else
+		max = min_t(size_t, space, PAGE_SIZE) /
+		      sizeof(struct simtemp_compact_record);
+
+	if (reader->events_only) {
+		n = simtemp_reader_fetch(reader, SIMTEMP_READ_CHUNK, &f);
+		seq = f.cursor - n;
+		valid = simtemp_reader_events(reader, &f, n, max);
+		/* Skipping samples is the point here, not an overrun */
+		lost = 0;
+	} else {
+		n = simtemp_reader_fetch(reader, max, &f);
+		seq = f.cursor - n;
+		valid = n - f.skip;
+		lost = f.lost + f.skip;
+	}
+
+	/* Mark the first sample delivered after a gap in this stream */
+	if (lost)
+		reader->gap = true;
+	if (reader->gap && valid)
+		reader->bounce[f.skip].flags |= SIMTEMP_FLAG_OVERRUN;
+
+	if (compact) {
+		rcu_read_lock();
+		period_ns = simtemp_output_period_ns(
+			rcu_dereference(simtemp->params));
+		rcu_read_unlock();
+
+		n = simtemp_compact_encode(&reader->compact,
+					   reader->bounce + f.skip, valid,
+					   period_ns, space, &len);
+		f.cursor -= valid - n;
+		valid = n;
+		src = reader->compact.buf;
+	} else {
+		src = reader->bounce + f.skip;
+		len = valid * sizeof(struct simtemp_sample);
+	}
 
-	if (copy_to_user(buf, &sample, sizeof(sample)))
+	if (copy_to_iter(src, len, to) != len)
 		return -EFAULT;
 
-	return sizeof(struct simtemp_sample);
+	/*
+	 * A flush or resize since the fetch invalidated the cursor: leave the
+	 * old generation in place so the next access restarts at the new tail
+	 */
+	rcu_read_lock();
+	ring = rcu_dereference(simtemp->ring);
+	if (smp_load_acquire(&ring->generation) == f.generation) {
+		WRITE_ONCE(reader->cursor, f.cursor);
+		WRITE_ONCE(reader->ring_gen, f.generation);
+	}
+	rcu_read_unlock();
+	if (valid)
+		reader->gap = false;
+
+	/* Latency runs from the sample's own timestamp to its hand-out */
+	if (valid && (trace_simtemp_read_dequeue_enabled() ||
+		      READ_ONCE(simtemp->hist_enabled))) {
+		now = ktime_get_ns();
+		trace_simtemp_read_dequeue(
+			simtemp->id, seq + f.skip, valid, lost,
+			now - reader->bounce[f.skip].timestamp_ns);
+
+		if (READ_ONCE(simtemp->hist_enabled))
+			for (i = f.skip; i < f.skip + valid; i++)
+				simtemp_hist_inc(simtemp, latency,
+						 now - reader->bounce[i].timestamp_ns);
+	}
+
+	if (lost) {
+		reader->overruns += lost;
+		WRITE_ONCE(simtemp->last_error, -EOVERFLOW);
+		simtemp_warn_ratelimited(simtemp,
+					 "Reader overrun, %u samples lost\n",
+					 lost);
+	}
+
+	return len;
 }
 
-static long simtemp_ioctl(struct file *file, unsigned int cmd,
-			  unsigned long arg)
+static void simtemp_window_free(struct simtemp_window *w)
 {
-	struct simtemp_device *simtemp = file->private_data;
-	struct simtemp_config config;
-	struct simtemp_ioctl_stats stats;
-	int ret = 0;
+	if (!w)
+		return;
 
-	if (_IOC_TYPE(cmd) != SIMTEMP_IOC_MAGIC)
-		return -ENOTTY;
-	if (_IOC_NR(cmd) > SIMTEMP_IOC_MAXNR)
-		return -ENOTTY;
+	kvfree(w->min_q);
+	kvfree(w->max_q);
+	kvfree(w);
+}
 
-	switch (cmd) {
-	case SIMTEMP_IOC_GET_CONFIG:
-		mutex_lock(&simtemp->config_lock);
-		config.sampling_ms = simtemp->sampling_ms;
-		config.threshold_mC = simtemp->threshold_mC;
-		config.mode = simtemp->mode;
-		config.flags = 0;
-		mutex_unlock(&simtemp->config_lock);
+static struct simtemp_window *simtemp_window_alloc(u32 size)
+{
+	u32 capacity = roundup_pow_of_two(size);
+	struct simtemp_window *w;
+
+	w = kvzalloc(struct_size(w, vals, size), GFP_KERNEL);
+	if (!w)
+		return NULL;
+
+	w->size = size;
+	w->mask = capacity - 1;
+	w->min_q = kvmalloc_array(capacity, sizeof(*w->min_q), GFP_KERNEL);
+	w->max_q = kvmalloc_array(capacity, sizeof(*w->max_q), GFP_KERNEL);
+	if (!w->min_q || !w->max_q) {
+		simtemp_window_free(w);
+		return NULL;
+	}
 
-		if (copy_to_user((void __user *)arg, &config, sizeof(config)))
-			ret = -EFAULT;
-		break;
+	return w;
+}
 
-	case SIMTEMP_IOC_SET_CONFIG:
-		if (copy_from_user(&config, (void __user *)arg,
-				   sizeof(config))) {
-			ret = -EFAULT;
-			break;
-		}
+/*
+ * Append sample 'seq' to a monotonic queue. The head leaves first once it
+ * falls out of the window, which a single new sample can only do to one
+ * entry, so the queue never holds more than w->size entries; older
+ * entries the new one beats can never be the extreme again and are
+ * dropped from the tail.
+ */
+static void simtemp_window_queue(struct simtemp_window *w,
+				 struct simtemp_window_entry *q, u32 *head,
+				 u32 *tail, u32 seq, s32 mC, bool max)
+{
+	if (*tail != *head && seq - q[*head & w->mask].seq >= w->size)
+		(*head)++;
+
+	while (*tail != *head &&
+	       (max ? q[(*tail - 1) & w->mask].mC <= mC :
+		      q[(*tail - 1) & w->mask].mC >= mC))
+		(*tail)--;
+
+	q[*tail & w->mask].seq = seq;
+	q[*tail & w->mask].mC = mC;
+	(*tail)++;
+}
+
+/* Add one raw sample to the rolling window, retiring the one it replaces */
+static void simtemp_window_push(struct simtemp_device *simtemp, s32 mC)
+{
+	struct simtemp_window *w;
+	unsigned long flags;
+	s32 old;
+
+	if (!READ_ONCE(simtemp->window))
+		return;
+
+	/* The producer may run in hard interrupt context */
+	spin_lock_irqsave(&simtemp->window_lock, flags);
+	w = simtemp->window;
+	if (!w)
+		goto out;
+
+	if (w->count == w->size) {
+		old = w->vals[w->pos];
+		w->sum -= old;
+		w->sum_sq -= (s64)old * old;
+	} else {
+		w->count++;
+	}
+
+	w->vals[w->pos] = mC;
+	if (++w->pos == w->size)
+		w->pos = 0;
+	w->sum += mC;
+	/* Wraps only for traces beyond about +-11000 °C at the largest size */
+	w->sum_sq += (s64)mC * mC;
+
+	simtemp_window_queue(w, w->min_q, &w->min_head, &w->min_tail, w->seq,
+			     mC, false);
+	simtemp_window_queue(w, w->max_q, &w->max_head, &w->max_tail, w->seq,
+			     mC, true);
+	w->seq++;
+
+out:
+	spin_unlock_irqrestore(&simtemp->window_lock, flags);
+}
+
+static void simtemp_window_snapshot(struct simtemp_device *simtemp,
+				    struct simtemp_window_stats *ws)
+{
+	struct simtemp_window *w;
+	unsigned long flags;
+	u64 mean_sq, var = 0;
+	s64 mean;
+
+	memset(ws, 0, sizeof(*ws));
+
+	spin_lock_irqsave(&simtemp->window_lock, flags);
+	w = simtemp->window;
+	if (w) {
+		ws->window = w->size;
+		ws->count = w->count;
+		ws->sum_mC = w->sum;
+		ws->sum_sq = w->sum_sq;
+		if (w->count) {
+			ws->min_mC = w->min_q[w->min_head & w->mask].mC;
+			ws->max_mC = w->max_q[w->max_head & w->mask].mC;
+		}
+	}
+	spin_unlock_irqrestore(&simtemp->window_lock, flags);
+
+	if (!ws->count)
+		return;
+
+	/* E[x^2] - E[x]^2; squaring the sum itself could overflow */
+	mean = div_s64(ws->sum_mC, ws->count);
+	mean_sq = div64_u64(ws->sum_sq, ws->count);
+	if (mean_sq > (u64)(mean * mean))
+		var = mean_sq - mean * mean;
+
+	ws->mean_mC = mean;
+	ws->stddev_mC = int_sqrt64(var);
+}
+
+/*
+ * Start over with an empty window of 'size' samples, or none for 0.
+ * Caller holds config_lock.
+ */
+static int simtemp_window_resize(struct simtemp_device *simtemp, u32 size)
+{
+	struct simtemp_window *w = NULL, *old;
+
+	if (size) {
+		w = simtemp_window_alloc(size);
+		if (!w)
+			return -ENOMEM;
+	}
+
+	spin_lock_irq(&simtemp->window_lock);
+	old = simtemp->window;
+	WRITE_ONCE(simtemp->window, w);
+	spin_unlock_irq(&simtemp->window_lock);
+
+	simtemp_window_free(old);
+	return 0;
+}
+
+/* Empty the window in place, keeping its size */
+static void simtemp_window_clear(struct simtemp_device *simtemp)
+{
+	struct simtemp_window *w;
+
+	spin_lock_irq(&simtemp->window_lock);
+	w = simtemp->window;
+	if (w) {
+		w->count = 0;
+		w->pos = 0;
+		w->sum = 0;
+		w->sum_sq = 0;
+		w->min_head = w->min_tail = 0;
+		w->max_head = w->max_tail = 0;
+	}
+	spin_unlock_irq(&simtemp->window_lock);
+}
+
+/*
+ * Fill in one sample taken at 'timestamp_ns', tracking threshold crossings.
+ * Returns false, leaving 'sample' untouched, at the end of a one-shot
+ * replay.
+ */
+static bool simtemp_make_sample(struct simtemp_device *simtemp,
+				const struct simtemp_params *p,
+				u64 timestamp_ns, struct simtemp_sample *sample)
+{
+	s32 temp;
+
+	if (!simtemp_get_base_temperature(simtemp, p, &temp))
+		return false;
+
+	simtemp_window_push(simtemp, temp);
+
+	sample->timestamp_ns = timestamp_ns;
+	sample->temp_mC = temp;
+	sample->flags = SIMTEMP_FLAG_NEW_SAMPLE;
+
+	/*
+	 * Rising through threshold_mC is a crossing; falling back only counts
+	 * once the temperature is hysteresis_mC below it, so noise around
+	 * the threshold does not chatter.
+	 */
+	if (simtemp->threshold_crossed ?
+		    (s64)temp < (s64)p->threshold_mC - p->hysteresis_mC :
+		    temp >= p->threshold_mC) {
+		WRITE_ONCE(simtemp->threshold_crossed,
+			   !simtemp->threshold_crossed);
+		WRITE_ONCE(simtemp->alert_seq, simtemp->alert_seq + 1);
+		sample->flags |= SIMTEMP_FLAG_THRESHOLD_CROSSED;
+		simtemp_stat_inc(simtemp, alerts);
+	}
+
+	simtemp->last_temp_mC = sample->temp_mC;
+	return true;
+}
+
+/*
+ * Run one raw sample through the filter stage and return how many samples
+ * (up to SIMTEMP_FILTER_MAX_OUT) it yields into 'out'. Each window of
+ * filter_window raw samples yields one, stamped with the window's last
+ * sample, or for min/max both extremes in the order they occurred. The
+ * flags are OR-ed over the window so no threshold crossing is lost.
+ * Producer only.
+ */
+static u32 simtemp_filter_apply(struct simtemp_device *simtemp,
+				const struct simtemp_params *p,
+				const struct simtemp_sample *raw,
+				struct simtemp_sample *out)
+{
+	struct simtemp_filter_state *st = &simtemp->filter_state;
+	enum simtemp_filter filter = p->filter;
+	u32 window = p->filter_window;
+	s64 temp_q8 = (s64)raw->temp_mC << 8;
+
+	if (filter == SIMTEMP_FILTER_NONE || window <= 1) {
+		out[0] = *raw;
+		return 1;
+	}
+
+	if (READ_ONCE(simtemp->filter_reset)) {
+		WRITE_ONCE(simtemp->filter_reset, false);
+		memset(st, 0, sizeof(*st));
+	}
+
+	if (!st->count) {
+		st->flags = 0;
+		st->sum = 0;
+		st->min = *raw;
+		st->max = *raw;
+	}
+
+	st->flags |= raw->flags;
+
+	switch (filter) {
+	case SIMTEMP_FILTER_BOXCAR:
+		st->sum += raw->temp_mC;
+		break;
+	case SIMTEMP_FILTER_EMA:
+		/* Runs across windows; the window only sets the output rate */
+		if (!st->ema_valid) {
+			st->ema = temp_q8;
+			st->ema_valid = true;
+		} else {
+			st->ema += div_s64(temp_q8 - st->ema, window);
+		}
+		break;
+	case SIMTEMP_FILTER_MINMAX:
+		if (raw->temp_mC < st->min.temp_mC)
+			st->min = *raw;
+		if (raw->temp_mC > st->max.temp_mC)
+			st->max = *raw;
+		break;
+	default:
+		break;
+	}
+
+	if (++st->count < window)
+		return 0;
+	st->count = 0;
+
+	out[0] = *raw;
+	out[0].flags = st->flags;
+
+	switch (filter) {
+	case SIMTEMP_FILTER_BOXCAR:
+		out[0].temp_mC = div_s64(st->sum, window);
+		break;
+	case SIMTEMP_FILTER_EMA:
+		out[0].temp_mC = div_s64(st->ema, 256);
+		break;
+	case SIMTEMP_FILTER_MINMAX:
+		if (st->max.timestamp_ns < st->min.timestamp_ns) {
+			out[0] = st->max;
+			out[1] = st->min;
+		} else {
+			out[0] = st->min;
+			out[1] = st->max;
+		}
+		out[0].flags = st->flags;
+		out[1].flags = st->flags;
+		return 2;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+/* Drain-mode replay is paced by read() instead of the timer */
+static bool simtemp_params_draining(const struct simtemp_params *p)
+{
+	return p->mode == SIMTEMP_MODE_REPLAY && p->replay_drain;
+}
+
+static bool simtemp_replay_draining(struct simtemp_device *simtemp)
+{
+	bool draining;
+
+	rcu_read_lock();
+	draining = simtemp_params_draining(rcu_dereference(simtemp->params));
+	rcu_read_unlock();
+
+	return draining;
+}
+
+/*
+ * A one-shot replay ran out: stop like a disable would, but from the
+ * producer itself. The timer sees 'enabled' clear and does not rearm.
+ */
+static void simtemp_replay_finished(struct simtemp_device *simtemp)
+{
+	WRITE_ONCE(simtemp->enabled, false);
+	simtemp_info(simtemp, "Replay finished\n");
+
+	/* Hand partially filled batches to readers waiting on a watermark */
+	simtemp_wake_readers(simtemp, ktime_get_ns());
+}
+
+/*
+ * Produce one timer tick's worth of samples. With a burst of K the tick
+ * fires every K sampling periods and, like a sensor draining its hardware
+ * FIFO, delivers K samples whose timestamps are spread back from 'now' at
+ * the logical sampling period. All of them go in before readers get a
+ * single wakeup. The whole tick works from one parameter snapshot.
+ */
+int simtemp_generate_sample(struct simtemp_device *simtemp)
+{
+	struct simtemp_sample sample, out[SIMTEMP_FILTER_MAX_OUT];
+	const struct simtemp_params *p;
+	struct simtemp_ring *ring;
+	u64 now, step_ns;
+	u32 burst, lag, i, j, n, crossings = 0, accepted = 0;
+	s32 crossing_temp = 0;
+	bool gap_started = false, finished = false;
+
+	if (!simtemp->enabled)
+		return 0;
+
+	now = ktime_get_ns();
+
+	rcu_read_lock();
+	p = rcu_dereference(simtemp->params);
+	ring = rcu_dereference(simtemp->ring);
+	burst = p->burst;
+	step_ns = (u64)simtemp_sample_us(p) * NSEC_PER_USEC;
+
+	/* Readers only ever shrink the lag, so one walk covers the burst */
+	lag = simtemp_ring_lag(simtemp, ring);
+
+	for (i = 0; i < burst; i++) {
+		if (!simtemp_make_sample(simtemp, p,
+					 now - (burst - 1 - i) * step_ns,
+					 &sample)) {
+			finished = true;
+			break;
+		}
+		if (sample.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED) {
+			crossings++;
+			crossing_temp = sample.temp_mC;
+		}
+
+		n = simtemp_filter_apply(simtemp, p, &sample, out);
+		for (j = 0; j < n; j++) {
+			if (lag >= ring->capacity) {
+				simtemp_stat_inc(simtemp, dropped);
+				WRITE_ONCE(simtemp->last_error, -EOVERFLOW);
+
+				if (p->overflow_policy ==
+				    SIMTEMP_OVERFLOW_DROP_NEWEST) {
+					gap_started |= !simtemp->overflow_gap;
+					simtemp->overflow_gap = true;
+					continue;
+				}
+			}
+
+			if (simtemp->overflow_gap)
+				out[j].flags |= SIMTEMP_FLAG_OVERRUN;
+			simtemp->overflow_gap = false;
+
+			simtemp_ring_push(ring, &out[j]);
+			trace_simtemp_sample_enqueue(simtemp->id, ring->head - 1,
+						     &out[j]);
+			lag++;
+			accepted++;
+		}
+	}
+
+	if (READ_ONCE(simtemp->hist_enabled))
+		simtemp_hist_inc(simtemp, occupancy, lag);
+
+	/* Raw and unconditional: a full ring does not hide the current value */
+	if (i)
+		simtemp_ring_publish_latest(ring, &sample);
+
+	rcu_read_unlock();
+
+	if (crossings) {
+		simtemp_dbg(simtemp, "Threshold crossed: temp=%d.%03d°C\n",
+			    crossing_temp / 1000, abs(crossing_temp % 1000));
+		simtemp_notify_alert(simtemp);
+	}
+
+	/* Log once per stall, not once per lost sample */
+	if (gap_started)
+		simtemp_warn_ratelimited(simtemp,
+					 "Sample buffer full, dropping new samples\n");
+
+	if (finished)
+		simtemp_replay_finished(simtemp);
+
+	if (!accepted)
+		return 0;
+
+	simtemp_stat_add(simtemp, updates, accepted);
+
+	simtemp_wake_readers(simtemp, now);
+
+	return 0;
+}
+
+static void simtemp_queue_sample_work(struct simtemp_device *simtemp)
+{
+	int cpu = simtemp->sample_cpu;
+
+	/* A bound high-priority pool on the chosen CPU, else the local one */
+	if (cpu >= 0)
+		queue_work_on(cpu, simtemp->wq, &simtemp->sample_work);
+	else
+		queue_work(simtemp->wq, &simtemp->sample_work);
+}
+
+/*
+ * Drain-mode producer: play the trace into whatever room the slowest
+ * read() consumer has left, at most SIMTEMP_DRAIN_BATCH samples per run,
+ * so it never laps anyone and needs no overflow handling. Each read()
+ * that consumed samples queues the next run; with nobody reading, the
+ * replay simply pauses. A run the filter swallowed whole queues itself
+ * again, as no reader has anything to consume and kick it with.
+ */
+static void simtemp_replay_fill(struct simtemp_device *simtemp)
+{
+	struct simtemp_sample sample, out[SIMTEMP_FILTER_MAX_OUT];
+	const struct simtemp_params *p;
+	struct simtemp_ring *ring;
+	u32 lag, room, raw, n, j, accepted = 0;
+	u32 alert_seq = simtemp->alert_seq;
+	bool finished = false;
+
+	if (!simtemp->enabled)
+		return;
+
+	rcu_read_lock();
+	p = rcu_dereference(simtemp->params);
+	ring = rcu_dereference(simtemp->ring);
+	lag = min(simtemp_ring_lag(simtemp, ring), ring->capacity);
+	room = min_t(u32, ring->capacity - lag, SIMTEMP_DRAIN_BATCH);
+
+	for (raw = 0; raw < SIMTEMP_DRAIN_BATCH &&
+		      accepted + SIMTEMP_FILTER_MAX_OUT <= room; raw++) {
+		if (!simtemp_make_sample(simtemp, p, ktime_get_ns(), &sample)) {
+			finished = true;
+			break;
+		}
+
+		n = simtemp_filter_apply(simtemp, p, &sample, out);
+		for (j = 0; j < n; j++) {
+			simtemp_ring_push(ring, &out[j]);
+			trace_simtemp_sample_enqueue(simtemp->id,
+						     ring->head - 1, &out[j]);
+		}
+		accepted += n;
+	}
+
+	if (raw)
+		simtemp_ring_publish_latest(ring, &sample);
+	rcu_read_unlock();
+
+	if (READ_ONCE(simtemp->hist_enabled))
+		simtemp_hist_inc(simtemp, occupancy, lag + accepted);
+
+	if (simtemp->alert_seq != alert_seq)
+		simtemp_notify_alert(simtemp);
+
+	if (finished) {
+		simtemp_replay_finished(simtemp);
+	} else if (!accepted && raw) {
+		simtemp_queue_sample_work(simtemp);
+		return;
+	}
+
+	if (!accepted)
+		return;
+
+	simtemp_stat_add(simtemp, updates, accepted);
+
+	simtemp_wake_readers(simtemp, ktime_get_ns());
+}
+
+void simtemp_sample_work(struct work_struct *work)
+{
+	struct simtemp_device *simtemp =
+		container_of(work, struct simtemp_device, sample_work);
+
+	if (simtemp_replay_draining(simtemp))
+		simtemp_replay_fill(simtemp);
+	else
+		simtemp_generate_sample(simtemp);
+}
+
+/*
+ * The timer runs in hard interrupt context (softirq on PREEMPT_RT, where
+ * HRTIMER_MODE_REL expiries are moved out of hardirq), so the sample is
+ * normally produced right here: generation is integer math plus the
+ * lockless ring push and the reader wakeups. The workqueue path is kept
+ * for when process context is wanted; it goes to the device's own
+ * WQ_HIGHPRI workqueue, on sample_cpu when one is set.
+ */
+enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer)
+{
+	struct simtemp_device *simtemp =
+		container_of(timer, struct simtemp_device, timer);
+	s64 expires, now;
+	ktime_t period;
+
+	/*
+	 * Lateness against the requested expiry, before any work is done;
+	 * with timer slack, anything up to the slack is coalescing, not jitter
+	 * the timer could have avoided.
+	 */
+	if (trace_simtemp_timer_expire_enabled() ||
+	    READ_ONCE(simtemp->hist_enabled)) {
+		expires = ktime_to_ns(hrtimer_get_softexpires(timer));
+		now = ktime_get_ns();
+		trace_simtemp_timer_expire(simtemp->id, expires, now);
+
+		if (READ_ONCE(simtemp->hist_enabled))
+			simtemp_hist_inc(simtemp, jitter,
+					 (u64)max_t(s64, now - expires, 0));
+	}
+
+	if (simtemp->sample_context == SIMTEMP_CONTEXT_HRTIMER)
+		simtemp_generate_sample(simtemp);
+	else
+		simtemp_queue_sample_work(simtemp);
+
+	if (!simtemp->enabled)
+		return HRTIMER_NORESTART;
+
+	rcu_read_lock();
+	period = rcu_dereference(simtemp->params)->period;
+	rcu_read_unlock();
+
+	hrtimer_forward_now(timer, period);
+	return HRTIMER_RESTART;
+}
+
+/* Caller holds config_lock */
+static struct simtemp_params *simtemp_params(struct simtemp_device *simtemp)
+{
+	return rcu_dereference_protected(simtemp->params,
+					 lockdep_is_held(&simtemp->config_lock));
+}
+
+/* One field of the current parameters, for readers off the hot path */
+#define simtemp_param(simtemp, field)                                   \
+	({                                                              \
+		typeof(((struct simtemp_params *)NULL)->field) __val;   \
+		rcu_read_lock();                                        \
+		__val = rcu_dereference((simtemp)->params)->field;      \
+		rcu_read_unlock();                                      \
+		__val;                                                  \
+	})
+
+/*
+ * Caller holds config_lock. Returns a private copy of the current
+ * parameters to modify and pass to simtemp_params_commit().
+ */
+static struct simtemp_params *simtemp_params_dup(struct simtemp_device *simtemp)
+{
+	return kmemdup(simtemp_params(simtemp), sizeof(struct simtemp_params),
+		       GFP_KERNEL);
+}
+
+static int simtemp_params_commit(struct simtemp_device *simtemp,
+				 struct simtemp_params *p);
+
+/* Change a single parameter; caller holds config_lock */
+#define simtemp_params_update(simtemp, field, val)                     \
+	({                                                              \
+		struct simtemp_params *__p = simtemp_params_dup(simtemp); \
+		int __ret = -ENOMEM;                                    \
+		if (__p) {                                              \
+			__p->field = (val);                             \
+			__ret = simtemp_params_commit(simtemp, __p);    \
+		}                                                       \
+		__ret;                                                  \
+	})
+
+/*
+ * The first expiry is one period from now, or with timer_align the next
+ * multiple of the period on CLOCK_MONOTONIC, so every aligned instance with
+ * the same (or a harmonic) period fires on the same ticks. The slack lets
+ * the hrtimer core expire it together with any other timer due in that
+ * window instead of taking a separate interrupt. hrtimer_forward_now()
+ * keeps both the grid phase and the slack for the following ticks.
+ */
+static void simtemp_start_timer(struct simtemp_device *simtemp, bool pinned)
+{
+	enum hrtimer_mode mode = pinned ? HRTIMER_MODE_PINNED : 0;
+	struct simtemp_params *p;
+	u64 period, expires, slack;
+	bool align;
+
+	rcu_read_lock();
+	p = rcu_dereference(simtemp->params);
+	period = ktime_to_ns(p->period);
+	slack = (u64)p->timer_slack_us * NSEC_PER_USEC;
+	align = p->timer_align;
+	rcu_read_unlock();
+
+	/* More than a period would let ticks merge with each other */
+	slack = min(slack, period);
+
+	if (align) {
+		expires = (div64_u64(ktime_get_ns(), period) + 1) * period;
+		mode |= HRTIMER_MODE_ABS;
+	} else {
+		expires = period;
+		mode |= HRTIMER_MODE_REL;
+	}
+
+	hrtimer_start_range_ns(&simtemp->timer, ns_to_ktime(expires), slack,
+			       mode);
+}
+
+/* Runs on the target CPU so the pinned timer lands on its clock base */
+static void simtemp_start_timer_local(void *data)
+{
+	simtemp_start_timer(data, true);
+}
+
+/* Caller holds config_lock */
+static void simtemp_arm_timer(struct simtemp_device *simtemp)
+{
+	/* Fails with -ENXIO if the CPU went offline; run unpinned then */
+	if (simtemp->sample_cpu >= 0 &&
+	    !smp_call_function_single(simtemp->sample_cpu,
+				      simtemp_start_timer_local, simtemp, 1))
+		return;
+
+	simtemp_start_timer(simtemp, false);
+}
+
+/* Caller holds config_lock */
+static void simtemp_start(struct simtemp_device *simtemp)
+{
+	struct simtemp_trace *trace;
+
+	if (simtemp->enabled || simtemp->gone)
+		return;
+
+	/* Re-enabling a one-shot replay that ran out plays it again */
+	if (simtemp_params(simtemp)->mode == SIMTEMP_MODE_REPLAY) {
+		trace = rcu_dereference_protected(
+			simtemp->trace, lockdep_is_held(&simtemp->config_lock));
+		if (!trace || simtemp->replay_pos >= trace->len)
+			WRITE_ONCE(simtemp->replay_rewind, true);
+	}
+
+	simtemp->enabled = true;
+
+	if (simtemp_params_draining(simtemp_params(simtemp)))
+		simtemp_queue_sample_work(simtemp);
+	else
+		simtemp_arm_timer(simtemp);
+}
+
+/* Caller holds config_lock */
+static void simtemp_stop(struct simtemp_device *simtemp)
+{
+	WRITE_ONCE(simtemp->enabled, false);
+	hrtimer_cancel(&simtemp->timer);
+
+	/* Hand partially filled batches to readers waiting on a watermark */
+	simtemp_wake_readers(simtemp, ktime_get_ns());
+}
+
+/*
+ * Caller holds config_lock. Publishes 'p', a copy from
+ * simtemp_params_dup(), in one step and makes it take effect at once: a
+ * period change re-arms the running timer rather than waiting out the
+ * old period, and a switch between the timer and the drain-mode work
+ * cycles sampling so the two never produce together. Entering replay
+ * starts the trace from the top. Fails, freeing 'p', when replay is
+ * selected with no trace loaded.
+ */
+static int simtemp_params_commit(struct simtemp_device *simtemp,
+				 struct simtemp_params *p)
+{
+	struct simtemp_params *old = simtemp_params(simtemp);
+	bool draining = simtemp_params_draining(p);
+	bool restart, rearm;
+
+	if (p->mode == SIMTEMP_MODE_REPLAY &&
+	    !rcu_access_pointer(simtemp->trace)) {
+		kfree(p);
+		return -ENODATA;
+	}
+
+	/* A burst of K stretches the tick to K periods, same sample rate */
+	p->period = ns_to_ktime((u64)simtemp_sample_us(p) * p->burst *
+				NSEC_PER_USEC);
+
+	restart = simtemp->enabled &&
+		  draining != simtemp_params_draining(old);
+	rearm = simtemp->enabled && !draining && !restart &&
+		(p->period != old->period ||
+		 p->timer_slack_us != old->timer_slack_us ||
+		 p->timer_align != old->timer_align);
+
+	if (restart) {
+		simtemp_stop(simtemp);
+		cancel_work_sync(&simtemp->sample_work);
+	}
+
+	if (p->mode == SIMTEMP_MODE_REPLAY && old->mode != SIMTEMP_MODE_REPLAY)
+		WRITE_ONCE(simtemp->replay_rewind, true);
+
+	rcu_assign_pointer(simtemp->params, p);
+	kfree_rcu(old, rcu);
+
+	if (restart) {
+		simtemp_start(simtemp);
+	} else if (rearm) {
+		/* Never restart under a running callback's hrtimer_forward() */
+		hrtimer_cancel(&simtemp->timer);
+		if (simtemp->enabled)
+			simtemp_arm_timer(simtemp);
+	}
+
+	return 0;
+}
+
+/*
+ * The last reference is gone: either the device was unbound with no file
+ * open, or the last file open across the unbind was closed. Copes with a
+ * probe that failed half way.
+ */
+static void simtemp_free(struct kref *ref)
+{
+	struct simtemp_device *simtemp =
+		container_of(ref, struct simtemp_device, ref);
+
+	if (simtemp->wq)
+		destroy_workqueue(simtemp->wq);
+
+	simtemp_window_free(simtemp->window);
+	kvfree(rcu_dereference_protected(simtemp->trace, 1));
+	simtemp_ring_free(rcu_dereference_protected(simtemp->ring, 1));
+	kfree(rcu_dereference_protected(simtemp->params, 1));
+	free_percpu(simtemp->hist);
+	free_percpu(simtemp->stats);
+
+	put_device(simtemp->dev);
+	kfree(simtemp);
+}
+
+static void simtemp_put(void *data)
+{
+	struct simtemp_device *simtemp = data;
+
+	kref_put(&simtemp->ref, simtemp_free);
+}
+
+/*
+ * Register the eventfd behind 'fd' as this file's alert notifier, replacing
+ * any previous one, or just drop the current one when 'fd' is negative.
+ */
+static int simtemp_reader_set_alert_eventfd(struct simtemp_reader *reader,
+					    int fd)
+{
+	struct eventfd_ctx *efd = NULL, *old;
+
+	if (fd >= 0) {
+		efd = eventfd_ctx_fdget(fd);
+		if (IS_ERR(efd))
+			return PTR_ERR(efd);
+	}
+
+	mutex_lock(&reader->lock);
+	old = rcu_replace_pointer(reader->alert_efd, efd,
+				  lockdep_is_held(&reader->lock));
+	mutex_unlock(&reader->lock);
+
+	if (old) {
+		/* The producer may be signalling it from simtemp_notify_alert() */
+		synchronize_rcu();
+		eventfd_ctx_put(old);
+	}
+
+	return 0;
+}
+
+static int simtemp_open(struct inode *inode, struct file *file)
+{
+	struct simtemp_device *simtemp = container_of(
+		file->private_data, struct simtemp_device, misc_dev);
+	struct simtemp_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->bounce = kmalloc_array(SIMTEMP_READ_CHUNK,
+				       sizeof(struct simtemp_sample),
+				       GFP_KERNEL);
+	if (!reader->bounce) {
+		kfree(reader);
+		return -ENOMEM;
+	}
+
+	/* Keeps simtemp alive past an unbind until this file is closed */
+	kref_get(&simtemp->ref);
+	reader->simtemp = simtemp;
+	mutex_init(&reader->lock);
+	init_waitqueue_head(&reader->wait);
+	reader->watermark = 1;
+	/*
+	 * Start with whatever the ring still holds, like the old shared fifo:
+	 * a generation that never matches makes the first access resolve the
+	 * cursor to the ring's oldest sample.
+	 */
+	reader->ring_gen = U32_MAX;
+	/* Only crossings from now on are pending alerts */
+	reader->alert_ack = READ_ONCE(simtemp->alert_seq);
+
+	if (atomic_inc_return(&simtemp->open_count) == 1)
+		simtemp_info(simtemp, "Device opened\n");
+
+	spin_lock(&simtemp->readers_lock);
+	list_add_tail_rcu(&reader->node, &simtemp->readers);
+	spin_unlock(&simtemp->readers_lock);
+
+	file->private_data = reader;
+	/* read_iter honours IOCB_NOWAIT, so io_uring can poll instead of punt */
+	file->f_mode |= FMODE_NOWAIT;
+	return 0;
+}
+
+static int simtemp_release(struct inode *inode, struct file *file)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_device *simtemp = reader->simtemp;
+
+	if (atomic_dec_return(&simtemp->open_count) == 0)
+		simtemp_info(simtemp, "Device closed\n");
+
+	spin_lock(&simtemp->readers_lock);
+	list_del_rcu(&reader->node);
+	spin_unlock(&simtemp->readers_lock);
+
+	/* A trace written through this file goes live once it is closed */
+	if (reader->upload)
+		simtemp_trace_install(simtemp, reader->upload);
+
+	simtemp_reader_set_alert_eventfd(reader, -1);
+
+	/* The producer may still be looking at us from simtemp_wake_readers() */
+	kfree(reader->compact.buf);
+	kfree(reader->bounce);
+	kfree_rcu(reader, rcu);
+
+	simtemp_put(simtemp);
+	return 0;
+}
+
+static __poll_t simtemp_poll(struct file *file, struct poll_table_struct *wait)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_device *simtemp = reader->simtemp;
+	__poll_t mask = 0;
+
+	simtemp_stat_inc(simtemp, poll_calls);
+
+	poll_wait(file, &reader->wait, wait);
+
+	if (READ_ONCE(simtemp->gone))
+		return EPOLLERR | EPOLLHUP;
+
+	if (simtemp_reader_ready(reader, ktime_get_ns()))
+		mask |= EPOLLIN | EPOLLRDNORM;
+
+	if (READ_ONCE(simtemp->alert_seq) != READ_ONCE(reader->alert_ack))
+		mask |= EPOLLPRI;
+
+	return mask;
+}
+
+/*
+ * read(), readv(), io_uring and splice() all land here. IOCB_NOWAIT (an
+ * io_uring attempt before it arms poll) is treated like O_NONBLOCK and
+ * must not sleep on reader->lock either.
+ */
+static ssize_t simtemp_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_device *simtemp = reader->simtemp;
+	bool nonblock = (file->f_flags & O_NONBLOCK) ||
+			(iocb->ki_flags & IOCB_NOWAIT);
+	size_t frame, count = iov_iter_count(to), done = 0;
+	ssize_t ret = 0;
+	bool compact;
+
+	if (READ_ONCE(simtemp->gone))
+		return -ENODEV;
+
+	simtemp_stat_inc(simtemp, read_calls);
+
+	if (iocb->ki_flags & IOCB_NOWAIT) {
+		if (!mutex_trylock(&reader->lock))
+			return -EAGAIN;
+	} else if (mutex_lock_interruptible(&reader->lock)) {
+		return -ERESTARTSYS;
+	}
+
+	/*
+	 * Only ever hand out whole samples, or whole compact frames. The
+	 * format is sampled once, so a SET_FORMAT while this read() sleeps
+	 * takes effect with the next one.
+	 */
+	compact = reader->format == SIMTEMP_FORMAT_COMPACT;
+	if (compact) {
+		frame = sizeof(struct simtemp_compact_sync);
+		/* Every read() decodes on its own */
+		reader->compact.resync = true;
+	} else {
+		frame = sizeof(struct simtemp_sample);
+	}
+
+	if (count < frame) {
+		mutex_unlock(&reader->lock);
+		return -EINVAL;
+	}
+
+	/* From now on drop-newest holds the producer back for this file */
+	WRITE_ONCE(reader->streaming, true);
+
+	while (count - done >= frame) {
+		/*
+		 * A blocking read sleeps until the watermark or latency limit
+		 * is met; a non-blocking one takes whatever is queued.
+		 */
+		if (!done && !(nonblock ? simtemp_reader_pending(reader) :
+				simtemp_reader_ready(reader, ktime_get_ns()))) {
+			mutex_unlock(&reader->lock);
+
+			if (nonblock)
+				return -EAGAIN;
+
+			ret = wait_event_interruptible(
+				reader->wait,
+				simtemp_reader_ready(reader, ktime_get_ns()) ||
+				READ_ONCE(simtemp->gone));
+			if (ret)
+				return ret;
+			if (READ_ONCE(simtemp->gone))
+				return -ENODEV;
+
+			if (mutex_lock_interruptible(&reader->lock))
+				return -ERESTARTSYS;
+			continue;
+		}
+
+		if (!simtemp_reader_pending(reader))
+			break;
+
+		ret = simtemp_reader_copy(reader, to, compact);
+		if (ret < 0)
+			break;
+
+		done += ret;
+	}
+
+	mutex_unlock(&reader->lock);
+
+	/* The consumer made room: let a draining replay refill it */
+	if (done && simtemp->enabled && simtemp_replay_draining(simtemp))
+		simtemp_queue_sample_work(simtemp);
+
+	if (!done && ret < 0)
+		return ret;
+
+	return done;
+}
+
+/*
+ * Writing uploads a replay trace: a flat array of native-endian s32
+ * temp_mC values, positioned by the file offset. It replaces the active
+ * trace when the file is closed, so a partial upload is never played.
+ */
+static ssize_t simtemp_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_trace *trace;
+	loff_t pos = *ppos;
+	u32 first, need;
+	ssize_t ret;
+
+	if (READ_ONCE(reader->simtemp->gone))
+		return -ENODEV;
+
+	if (pos % sizeof(s32) || count % sizeof(s32))
+		return -EINVAL;
+
+	if (!count)
+		return 0;
+
+	if (pos + count > (loff_t)SIMTEMP_MAX_TRACE_LEN * sizeof(s32))
+		return -EFBIG;
+
+	first = pos / sizeof(s32);
+	need = first + count / sizeof(s32);
+
+	if (mutex_lock_interruptible(&reader->lock))
+		return -ERESTARTSYS;
+
+	trace = reader->upload;
+	if (!trace || need > trace->capacity) {
+		trace = simtemp_trace_grow(trace, need);
+		if (!trace) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		reader->upload = trace;
+	}
+
+	if (copy_from_user(&trace->mC[first], buf, count)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	trace->len = max(trace->len, need);
+	*ppos = pos + count;
+	ret = count;
+out:
+	mutex_unlock(&reader->lock);
+	return ret;
+}
+
+static void simtemp_vma_open(struct vm_area_struct *vma)
+{
+	struct simtemp_device *simtemp = vma->vm_private_data;
+
+	atomic_inc(&simtemp->ring_maps);
+}
+
+static void simtemp_vma_close(struct vm_area_struct *vma)
+{
+	struct simtemp_device *simtemp = vma->vm_private_data;
+
+	atomic_dec(&simtemp->ring_maps);
+}
+
+static const struct vm_operations_struct simtemp_vm_ops = {
+	.open = simtemp_vma_open,
+	.close = simtemp_vma_close,
+};
+
+static int simtemp_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_device *simtemp = reader->simtemp;
+	struct simtemp_ring *ring;
+	int ret;
+
+	if (READ_ONCE(simtemp->gone))
+		return -ENODEV;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	/* Cursors are private to each consumer, the ring is read-only */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	mutex_lock(&simtemp->ring_lock);
+	ring = rcu_dereference_protected(simtemp->ring,
+					 lockdep_is_held(&simtemp->ring_lock));
+
+	if (vma->vm_end - vma->vm_start > ring->size) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	ret = remap_vmalloc_range(vma, ring->hdr, 0);
+	if (ret)
+		goto out_unlock;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+	vma->vm_private_data = simtemp;
+	vma->vm_ops = &simtemp_vm_ops;
+	simtemp_vma_open(vma);
+
+	/* The driver cannot see this consumer's cursor */
+	WRITE_ONCE(reader->mapped, true);
+
+out_unlock:
+	mutex_unlock(&simtemp->ring_lock);
+	return ret;
+}
+
+/* Caller holds stats_lock */
+static void simtemp_stats_sum(struct simtemp_device *simtemp,
+			      struct simtemp_stats *sum)
+{
+	const struct simtemp_stats *pcpu;
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(simtemp->stats, cpu);
+		sum->updates += READ_ONCE(pcpu->updates);
+		sum->alerts += READ_ONCE(pcpu->alerts);
+		sum->read_calls += READ_ONCE(pcpu->read_calls);
+		sum->poll_calls += READ_ONCE(pcpu->poll_calls);
+		sum->dropped += READ_ONCE(pcpu->dropped);
+	}
+}
+
+/*
+ * Totals since the last reset. Every counter is exact, but they are summed
+ * one CPU at a time, so the set is not frozen at a single instant.
+ */
+static void simtemp_stats_snapshot(struct simtemp_device *simtemp,
+				   struct simtemp_stats *snap)
+{
+	mutex_lock(&simtemp->stats_lock);
+	simtemp_stats_sum(simtemp, snap);
+	snap->updates -= simtemp->stats_base.updates;
+	snap->alerts -= simtemp->stats_base.alerts;
+	snap->read_calls -= simtemp->stats_base.read_calls;
+	snap->poll_calls -= simtemp->stats_base.poll_calls;
+	snap->dropped -= simtemp->stats_base.dropped;
+	mutex_unlock(&simtemp->stats_lock);
+}
+
+/*
+ * The per-CPU counters are only ever written by their own CPU, so a reset
+ * records the current totals as the new baseline instead of clearing them.
+ */
+static void simtemp_stats_reset(struct simtemp_device *simtemp)
+{
+	mutex_lock(&simtemp->stats_lock);
+	simtemp_stats_sum(simtemp, &simtemp->stats_base);
+	WRITE_ONCE(simtemp->last_error, 0);
+	mutex_unlock(&simtemp->stats_lock);
+}
+
+/* Ring fill level in percent */
+static u32 simtemp_buffer_usage(struct simtemp_device *simtemp)
+{
+	struct simtemp_ring *ring;
+	u32 usage;
+
+	rcu_read_lock();
+	ring = rcu_dereference(simtemp->ring);
+	usage = div_u64((u64)simtemp_ring_count(ring) * 100, ring->capacity);
+	rcu_read_unlock();
+
+	return usage;
+}
+
+/*
+ * Publish a validated SET_CONFIG; all three fields reach the producer
+ * together. With SIMTEMP_CONFIG_APPLY the change is one stop-to-restart
+ * transition, so no sample of the old configuration follows one of the
+ * new. Caller holds config_lock.
+ */
+static int simtemp_set_config(struct simtemp_device *simtemp,
+			      const struct simtemp_config *config)
+{
+	struct simtemp_params *p;
+	bool was_enabled;
+	int ret;
+
+	p = simtemp_params_dup(simtemp);
+	if (!p)
+		return -ENOMEM;
+
+	p->sampling_us = config->sampling_us;
+	p->threshold_mC = config->threshold_mC;
+	p->mode = config->mode;
+
+	if (!(config->flags & SIMTEMP_CONFIG_APPLY))
+		return simtemp_params_commit(simtemp, p);
+
+	was_enabled = simtemp->enabled;
+	simtemp_stop(simtemp);
+	cancel_work_sync(&simtemp->sample_work);
+
+	/* On failure the old values carry on as before */
+	ret = simtemp_params_commit(simtemp, p);
+	if (!ret && config->flags & SIMTEMP_CONFIG_FLUSH) {
+		simtemp_ring_flush(simtemp);
+		simtemp_window_clear(simtemp);
+		WRITE_ONCE(simtemp->filter_reset, true);
+		simtemp->overflow_gap = false;
+	}
+
+	/* A fresh start also gives the timer a fresh phase */
+	if (was_enabled || (!ret && config->flags & SIMTEMP_CONFIG_ENABLE))
+		simtemp_start(simtemp);
+
+	return ret;
+}
+
+/* Caller holds config_lock. Empties the ring for every reader at once */
+static void simtemp_flush_buffer(struct simtemp_device *simtemp)
+{
+	bool was_enabled = simtemp->enabled;
+
+	/* The flush writes the tail, which the producer owns while it runs */
+	simtemp_stop(simtemp);
+	cancel_work_sync(&simtemp->sample_work);
+
+	simtemp_ring_flush(simtemp);
+	simtemp->overflow_gap = false;
+
+	if (was_enabled)
+		simtemp_start(simtemp);
+}
+
+/* Drop this reader's backlog without touching the ring or other readers */
+static void simtemp_reader_flush(struct simtemp_reader *reader)
+{
+	struct simtemp_ring *ring;
+
+	mutex_lock(&reader->lock);
+	rcu_read_lock();
+	ring = rcu_dereference(reader->simtemp->ring);
+	WRITE_ONCE(reader->ring_gen, smp_load_acquire(&ring->generation));
+	WRITE_ONCE(reader->cursor, smp_load_acquire(&ring->head));
+	rcu_read_unlock();
+	mutex_unlock(&reader->lock);
+}
+
+static long simtemp_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_device *simtemp = reader->simtemp;
+	struct simtemp_config config;
+	struct simtemp_ioctl_stats stats;
+	struct simtemp_stats snap;
+	struct simtemp_reader_stats rstats;
+	struct simtemp_watermark wm;
+	struct simtemp_sample latest;
+	struct simtemp_alert alert;
+	struct simtemp_window_stats wstats;
+	struct simtemp_params *p;
+	u32 size, filter, format;
+	s32 fd;
+	int ret = 0;
+
+	if (_IOC_TYPE(cmd) != SIMTEMP_IOC_MAGIC)
+		return -ENOTTY;
+	if (_IOC_NR(cmd) > SIMTEMP_IOC_MAXNR)
+		return -ENOTTY;
+	if (READ_ONCE(simtemp->gone))
+		return -ENODEV;
+
+	/* The V1 layouts are prefixes of the current ones */
+	BUILD_BUG_ON(offsetofend(struct simtemp_config, flags) !=
+		     SIMTEMP_CONFIG_V1_SIZE);
+	BUILD_BUG_ON(offsetofend(struct simtemp_ioctl_stats, buffer_usage) !=
+		     SIMTEMP_IOCTL_STATS_V1_SIZE);
+
+	switch (cmd) {
+	case SIMTEMP_IOC_GET_CONFIG_V1:
+	case SIMTEMP_IOC_GET_CONFIG:
+		mutex_lock(&simtemp->config_lock);
+		p = simtemp_params(simtemp);
+		config.sampling_ms = p->sampling_us / USEC_PER_MSEC;
+		config.sampling_us = p->sampling_us;
+		config.threshold_mC = p->threshold_mC;
+		config.mode = p->mode;
+		config.flags = 0;
+		mutex_unlock(&simtemp->config_lock);
+
+		if (copy_to_user((void __user *)arg, &config, _IOC_SIZE(cmd)))
+			ret = -EFAULT;
+		break;
+
+	case SIMTEMP_IOC_SET_CONFIG_V1:
+	case SIMTEMP_IOC_SET_CONFIG:
+		/* A V1 caller has no sampling_us, which leaves it at 0 */
+		memset(&config, 0, sizeof(config));
+		if (copy_from_user(&config, (void __user *)arg,
+				   _IOC_SIZE(cmd))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (!config.sampling_us) {
+			if (config.sampling_ms < SIMTEMP_MIN_SAMPLING_MS ||
+			    config.sampling_ms > SIMTEMP_MAX_SAMPLING_MS) {
+				ret = -EINVAL;
+				break;
+			}
+			config.sampling_us = config.sampling_ms * USEC_PER_MSEC;
+		}
+
+		if (config.sampling_us < SIMTEMP_MIN_SAMPLING_US ||
+		    config.sampling_us > SIMTEMP_MAX_SAMPLING_US ||
+		    config.mode >= SIMTEMP_MODE_MAX ||
+		    config.flags & ~SIMTEMP_CONFIG_FLAGS ||
+		    (config.flags && !(config.flags & SIMTEMP_CONFIG_APPLY))) {
+			ret = -EINVAL;
+			break;
+		}
+
+		mutex_lock(&simtemp->config_lock);
+		ret = simtemp_set_config(simtemp, &config);
+		mutex_unlock(&simtemp->config_lock);
+		break;
+
+	case SIMTEMP_IOC_SET_WATERMARK:
+		if (copy_from_user(&wm, (void __user *)arg, sizeof(wm))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (wm.samples > SIMTEMP_MAX_BUFFER_SIZE) {
+			ret = -EINVAL;
+			break;
+		}
+
+		mutex_lock(&reader->lock);
+		WRITE_ONCE(reader->watermark, max(wm.samples, 1U));
+		WRITE_ONCE(reader->timeout_ms, wm.timeout_ms);
+		mutex_unlock(&reader->lock);
+
+		/* The new condition may already hold */
+		wake_up_interruptible_poll(&reader->wait,
+					   EPOLLIN | EPOLLRDNORM);
+		break;
+
+	case SIMTEMP_IOC_SET_BUFFER_SIZE:
+		if (get_user(size, (__u32 __user *)arg)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		mutex_lock(&simtemp->config_lock);
+		ret = simtemp_ring_resize(simtemp, size);
+		mutex_unlock(&simtemp->config_lock);
+		break;
+
+	case SIMTEMP_IOC_GET_LATEST:
+		ret = simtemp_get_latest(simtemp, &latest);
+		if (!ret && copy_to_user((void __user *)arg, &latest,
+					 sizeof(latest)))
+			ret = -EFAULT;
+		break;
+
+	case SIMTEMP_IOC_SET_READ_FILTER:
+		if (get_user(filter, (__u32 __user *)arg)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (filter & ~SIMTEMP_READ_EVENTS_ONLY) {
+			ret = -EINVAL;
+			break;
+		}
+
+		mutex_lock(&reader->lock);
+		WRITE_ONCE(reader->events_only,
+			   !!(filter & SIMTEMP_READ_EVENTS_ONLY));
+		mutex_unlock(&reader->lock);
+
+		/* Switching back to every sample may have made it ready */
+		wake_up_interruptible_poll(&reader->wait,
+					   EPOLLIN | EPOLLRDNORM);
+		break;
+
+	case SIMTEMP_IOC_SET_FORMAT:
+		if (get_user(format, (__u32 __user *)arg)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (format > SIMTEMP_FORMAT_COMPACT) {
+			ret = -EINVAL;
+			break;
+		}
+
+		/* The staging buffer stays once allocated */
+		mutex_lock(&reader->lock);
+		if (format == SIMTEMP_FORMAT_COMPACT && !reader->compact.buf) {
+			reader->compact.buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+			if (!reader->compact.buf)
+				ret = -ENOMEM;
+		}
+		if (!ret)
+			reader->format = format;
+		mutex_unlock(&reader->lock);
+		break;
+
+	case SIMTEMP_IOC_SET_ALERT_EVENTFD:
+		if (get_user(fd, (__s32 __user *)arg)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ret = simtemp_reader_set_alert_eventfd(reader, fd);
+		break;
+
+	case SIMTEMP_IOC_GET_ALERT:
+		mutex_lock(&reader->lock);
+		alert.seq = READ_ONCE(simtemp->alert_seq);
+		alert.count = alert.seq - reader->alert_ack;
+		alert.above = READ_ONCE(simtemp->threshold_crossed);
+		alert.reserved = 0;
+		WRITE_ONCE(reader->alert_ack, alert.seq);
+		mutex_unlock(&reader->lock);
+
+		if (copy_to_user((void __user *)arg, &alert, sizeof(alert)))
+			ret = -EFAULT;
+		break;
+
+	case SIMTEMP_IOC_GET_WINDOW_STATS:
+		simtemp_window_snapshot(simtemp, &wstats);
+		if (copy_to_user((void __user *)arg, &wstats, sizeof(wstats)))
+			ret = -EFAULT;
+		break;
+
+	case SIMTEMP_IOC_GET_STATS_V1:
+	case SIMTEMP_IOC_GET_STATS:
+		simtemp_stats_snapshot(simtemp, &snap);
+		stats.updates = snap.updates;
+		stats.alerts = snap.alerts;
+		stats.read_calls = snap.read_calls;
+		stats.poll_calls = snap.poll_calls;
+		stats.last_error = READ_ONCE(simtemp->last_error);
+		stats.buffer_usage =
+			simtemp_buffer_usage(simtemp);
+		stats.dropped = snap.dropped;
+
+		if (copy_to_user((void __user *)arg, &stats, _IOC_SIZE(cmd)))
+			ret = -EFAULT;
+		break;
+
+	case SIMTEMP_IOC_RESET_STATS:
+		simtemp_stats_reset(simtemp);
+		break;
+
+	case SIMTEMP_IOC_ENABLE:
+		mutex_lock(&simtemp->config_lock);
+		simtemp_start(simtemp);
+		mutex_unlock(&simtemp->config_lock);
+		break;
+
+	case SIMTEMP_IOC_DISABLE:
+		mutex_lock(&simtemp->config_lock);
+		simtemp_stop(simtemp);
+		mutex_unlock(&simtemp->config_lock);
+		break;
+
+	case SIMTEMP_IOC_FLUSH_BUFFER:
+		mutex_lock(&simtemp->config_lock);
+		simtemp_flush_buffer(simtemp);
+		mutex_unlock(&simtemp->config_lock);
+		/* The caller asked for it, so its own backlog is not an overrun */
+		simtemp_reader_flush(reader);
+		break;
+
+	case SIMTEMP_IOC_FLUSH_READER:
+		simtemp_reader_flush(reader);
+		break;
+
+	case SIMTEMP_IOC_GET_READER_STATS:
+		mutex_lock(&reader->lock);
+		rstats.overruns = reader->overruns;
+		rcu_read_lock();
+		rstats.backlog = simtemp_reader_backlog(
+			reader, rcu_dereference(simtemp->ring));
+		rcu_read_unlock();
+		rstats.reserved = 0;
+		mutex_unlock(&reader->lock);
+
+		if (copy_to_user((void __user *)arg, &rstats, sizeof(rstats)))
+			ret = -EFAULT;
+		break;
+
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+
+	return ret;
+}
+
+static const struct file_operations simtemp_fops = {
+	.owner = THIS_MODULE,
+	.open = simtemp_open,
+	.release = simtemp_release,
+	.read_iter = simtemp_read_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	.splice_read = copy_splice_read,
+#else
+	.splice_read = generic_file_splice_read,
+#endif
+	.write = simtemp_write,
+	.poll = simtemp_poll,
+	.mmap = simtemp_mmap,
+	.unlocked_ioctl = simtemp_ioctl,
+	.llseek = noop_llseek,
+};
+
+static ssize_t sampling_ms_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n",
+		       simtemp_param(simtemp, sampling_us) / USEC_PER_MSEC);
+}
+
+static ssize_t sampling_us_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, sampling_us));
+}
+
+static ssize_t threshold_mC_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", simtemp_param(simtemp, threshold_mC));
+}
+
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	enum simtemp_mode mode = simtemp_param(simtemp, mode);
+
+	if (mode >= ARRAY_SIZE(simtemp_mode_names))
+		return sprintf(buf, "unknown\n");
+
+	return sprintf(buf, "%s\n", simtemp_mode_names[mode]);
+}
+
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	struct simtemp_stats snap;
+
+	simtemp_stats_snapshot(simtemp, &snap);
+
+	return sprintf(
+		buf,
+		"updates: %lu\nalerts: %lu\nread_calls: %lu\npoll_calls: %lu\nlast_error: %d\nbuffer_usage: %u%%\ndropped: %lu\n",
+		snap.updates, snap.alerts, snap.read_calls, snap.poll_calls,
+		READ_ONCE(simtemp->last_error), simtemp_buffer_usage(simtemp),
+		snap.dropped);
+}
+static DEVICE_ATTR_RO(stats);
+
+static ssize_t stats_window_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 size;
+
+	mutex_lock(&simtemp->config_lock);
+	size = simtemp->window ? simtemp->window->size : 0;
+	mutex_unlock(&simtemp->config_lock);
+
+	return sprintf(buf, "%u\n", size);
+}
+
+static ssize_t stats_window_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val > SIMTEMP_MAX_STATS_WINDOW)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_window_resize(simtemp, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(stats_window);
+
+static ssize_t window_stats_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	struct simtemp_window_stats ws;
+
+	simtemp_window_snapshot(simtemp, &ws);
+
+	return sprintf(
+		buf,
+		"window: %u\ncount: %u\nmin_mC: %d\nmax_mC: %d\nmean_mC: %d\nstddev_mC: %u\nsum_mC: %lld\nsum_sq: %llu\n",
+		ws.window, ws.count, ws.min_mC, ws.max_mC, ws.mean_mC,
+		ws.stddev_mC, ws.sum_mC, ws.sum_sq);
+}
+static DEVICE_ATTR_RO(window_stats);
+
+static ssize_t buffer_size_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 capacity;
+
+	rcu_read_lock();
+	capacity = rcu_dereference(simtemp->ring)->capacity;
+	rcu_read_unlock();
+
+	return sprintf(buf, "%u\n", capacity);
+}
+
+static ssize_t buffer_size_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_ring_resize(simtemp, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(buffer_size);
+
+static ssize_t enabled_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", simtemp->enabled ? 1 : 0);
+}
+
+static ssize_t sampling_ms_store(struct device *dev,
+				 struct device_attribute *attr, const char *buf,
+				 size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val < SIMTEMP_MIN_SAMPLING_MS || val > SIMTEMP_MAX_SAMPLING_MS)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, sampling_us, val * USEC_PER_MSEC);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(sampling_ms);
+
+static ssize_t sampling_us_store(struct device *dev,
+				 struct device_attribute *attr, const char *buf,
+				 size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val < SIMTEMP_MIN_SAMPLING_US || val > SIMTEMP_MAX_SAMPLING_US)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, sampling_us, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(sampling_us);
+
+static ssize_t burst_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, burst));
+}
+
+static ssize_t burst_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val < 1 || val > SIMTEMP_MAX_BURST)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, burst, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(burst);
+
+static ssize_t threshold_mC_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	int val;
+	int ret;
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, threshold_mC, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(threshold_mC);
+
+static ssize_t hysteresis_mC_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, hysteresis_mC));
+}
+
+static ssize_t hysteresis_mC_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val > SIMTEMP_MAX_HYSTERESIS_MC)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, hysteresis_mC, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(hysteresis_mC);
+
+static ssize_t timer_slack_us_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, timer_slack_us));
+}
+
+static ssize_t timer_slack_us_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val > SIMTEMP_MAX_TIMER_SLACK_US)
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, timer_slack_us, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(timer_slack_us);
+
+static ssize_t timer_align_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", simtemp_param(simtemp, timer_align) ? 1 : 0);
+}
+
+static ssize_t timer_align_store(struct device *dev,
+				 struct device_attribute *attr, const char *buf,
+				 size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, timer_align, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(timer_align);
+
+/* Current temperature in milli-degrees, like hwmon's temp*_input */
+static ssize_t temp_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	struct simtemp_sample latest;
+	int ret;
+
+	ret = simtemp_get_latest(simtemp, &latest);
+	if (ret)
+		return ret;
+
+	return sprintf(buf, "%d\n", latest.temp_mC);
+}
+static DEVICE_ATTR_RO(temp);
+
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	int mode, ret;
+
+	mode = sysfs_match_string(simtemp_mode_names, buf);
+	if (mode < 0)
+		return mode;
+
+	/* Selecting replay always starts the trace from the top */
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, mode, mode);
+	if (!ret && mode == SIMTEMP_MODE_REPLAY)
+		WRITE_ONCE(simtemp->replay_rewind, true);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(mode);
+
+static ssize_t replay_loop_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", simtemp_param(simtemp, replay_loop) ? 1 : 0);
+}
+
+static ssize_t replay_loop_store(struct device *dev,
+				 struct device_attribute *attr, const char *buf,
+				 size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, replay_loop, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(replay_loop);
+
+static ssize_t replay_us_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, replay_us));
+}
+
+static ssize_t replay_us_store(struct device *dev,
+			       struct device_attribute *attr, const char *buf,
+			       size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	/* 0 makes the replay follow sampling_us again */
+	if (val && (val < SIMTEMP_MIN_SAMPLING_US ||
+		    val > SIMTEMP_MAX_SAMPLING_US))
+		return -EINVAL;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, replay_us, val);
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(replay_us);
+
+static ssize_t replay_drain_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
 
-		if (config.sampling_ms < SIMTEMP_MIN_SAMPLING_MS ||
-		    config.sampling_ms > SIMTEMP_MAX_SAMPLING_MS ||
-		    config.mode >= SIMTEMP_MODE_MAX) {
-			ret = -EINVAL;
-			break;
-		}
+	return sprintf(buf, "%d\n", simtemp_param(simtemp, replay_drain) ? 1 : 0);
+}
 
-		mutex_lock(&simtemp->config_lock);
-		simtemp->sampling_ms = config.sampling_ms;
-		simtemp->threshold_mC = config.threshold_mC;
-		simtemp->mode = config.mode;
-		mutex_unlock(&simtemp->config_lock);
-		break;
+static ssize_t replay_drain_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	bool val;
+	int ret;
 
-	case SIMTEMP_IOC_GET_STATS:
-		stats.updates = simtemp->stats.updates;
-		stats.alerts = simtemp->stats.alerts;
-		stats.read_calls = simtemp->stats.read_calls;
-		stats.poll_calls = simtemp->stats.poll_calls;
-		stats.last_error = simtemp->stats.last_error;
-		stats.buffer_usage =
-			(kfifo_len(&simtemp->sample_buffer) * 100) /
-			SIMTEMP_BUFFER_SIZE;
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
 
-		if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
-			ret = -EFAULT;
-		break;
+	/* The commit swaps the timer and the work item over if needed */
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, replay_drain, val);
+	mutex_unlock(&simtemp->config_lock);
 
-	case SIMTEMP_IOC_RESET_STATS:
-		memset(&simtemp->stats, 0, sizeof(simtemp->stats));
-		break;
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(replay_drain);
 
-	case SIMTEMP_IOC_ENABLE:
-		mutex_lock(&simtemp->config_lock);
-		if (!simtemp->enabled) {
-			simtemp->enabled = true;
-			hrtimer_start(&simtemp->timer,
-				      ms_to_ktime(simtemp->sampling_ms),
-				      HRTIMER_MODE_REL);
-		}
-		mutex_unlock(&simtemp->config_lock);
-		break;
+/*
+ * Loads a replay trace through the firmware loader: the file holds the
+ * same flat s32 array that write() accepts.
+ */
+static ssize_t replay_firmware_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	const struct firmware *fw;
+	struct simtemp_trace *trace;
+	char name[NAME_MAX + 1];
+	int ret;
 
-	case SIMTEMP_IOC_DISABLE:
-		mutex_lock(&simtemp->config_lock);
-		simtemp->enabled = false;
-		hrtimer_cancel(&simtemp->timer);
-		mutex_unlock(&simtemp->config_lock);
-		break;
+	if (strscpy(name, buf, sizeof(name)) < 0)
+		return -EINVAL;
+	strim(name);
+	if (!name[0])
+		return -EINVAL;
 
-	case SIMTEMP_IOC_FLUSH_BUFFER:
-		kfifo_reset(&simtemp->sample_buffer);
-		break;
+	ret = request_firmware(&fw, name, dev);
+	if (ret)
+		return ret;
 
-	default:
-		ret = -ENOTTY;
-		break;
+	if (!fw->size || fw->size % sizeof(s32) ||
+	    fw->size > SIMTEMP_MAX_TRACE_LEN * sizeof(s32)) {
+		ret = -EINVAL;
+		goto out;
 	}
 
-	return ret;
-}
+	trace = simtemp_trace_alloc(fw->size / sizeof(s32));
+	if (!trace) {
+		ret = -ENOMEM;
+		goto out;
+	}
 
-static const struct file_operations simtemp_fops = {
-	.owner = THIS_MODULE,
-	.open = simtemp_open,
-	.release = simtemp_release,
-	.read = simtemp_read,
-	.poll = simtemp_poll,
-	.unlocked_ioctl = simtemp_ioctl,
-	.llseek = noop_llseek,
-};
+	memcpy(trace->mC, fw->data, fw->size);
+	trace->len = trace->capacity;
+	simtemp_trace_install(simtemp, trace);
+out:
+	release_firmware(fw);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_WO(replay_firmware);
 
-static ssize_t sampling_ms_show(struct device *dev,
-				struct device_attribute *attr, char *buf)
+static ssize_t overflow_policy_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
 
-	return sprintf(buf, "%u\n", simtemp->sampling_ms);
+	return sprintf(buf, "%s\n",
+		       simtemp_overflow_names[simtemp_param(simtemp,
+							    overflow_policy)]);
 }
 
-static ssize_t threshold_mC_show(struct device *dev,
-				 struct device_attribute *attr, char *buf)
+static ssize_t overflow_policy_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	int policy, ret;
+
+	policy = sysfs_match_string(simtemp_overflow_names, buf);
+	if (policy < 0)
+		return policy;
+
+	mutex_lock(&simtemp->config_lock);
+	ret = simtemp_params_update(simtemp, overflow_policy, policy);
+	mutex_unlock(&simtemp->config_lock);
 
-	return sprintf(buf, "%d\n", simtemp->threshold_mC);
+	return ret ? ret : count;
 }
+static DEVICE_ATTR_RW(overflow_policy);
 
-static ssize_t mode_show(struct device *dev, struct device_attribute *attr,
-			 char *buf)
+static ssize_t sample_context_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
-	static const char *const mode_names[] = { "normal", "noisy", "ramp" };
-
-	if (simtemp->mode >= ARRAY_SIZE(mode_names))
-		return sprintf(buf, "unknown\n");
 
-	return sprintf(buf, "%s\n", mode_names[simtemp->mode]);
+	return sprintf(buf, "%s\n",
+		       simtemp_context_names[simtemp->sample_context]);
 }
 
-static ssize_t stats_show(struct device *dev, struct device_attribute *attr,
-			  char *buf)
+static ssize_t sample_context_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	int context, ret = 0;
 
-	return sprintf(
-		buf,
-		"updates: %lu\nalerts: %lu\nread_calls: %lu\npoll_calls: %lu\nlast_error: %d\nbuffer_usage: %u%%\n",
-		simtemp->stats.updates, simtemp->stats.alerts,
-		simtemp->stats.read_calls, simtemp->stats.poll_calls,
-		simtemp->stats.last_error,
-		(kfifo_len(&simtemp->sample_buffer) * 100) /
-			SIMTEMP_BUFFER_SIZE);
+	context = sysfs_match_string(simtemp_context_names, buf);
+	if (context < 0)
+		return context;
+
+	/* Never let the timer and a pending work item produce together */
+	mutex_lock(&simtemp->config_lock);
+	if (simtemp->enabled) {
+		ret = -EBUSY;
+	} else {
+		cancel_work_sync(&simtemp->sample_work);
+		simtemp->sample_context = context;
+	}
+	mutex_unlock(&simtemp->config_lock);
+
+	return ret ? ret : count;
 }
-static DEVICE_ATTR_RO(stats);
+static DEVICE_ATTR_RW(sample_context);
 
-static ssize_t enabled_show(struct device *dev, struct device_attribute *attr,
-			    char *buf)
+static ssize_t sample_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
 
-	return sprintf(buf, "%d\n", simtemp->enabled ? 1 : 0);
+	return sprintf(buf, "%d\n", simtemp->sample_cpu);
 }
 
-static ssize_t sampling_ms_store(struct device *dev,
-				 struct device_attribute *attr, const char *buf,
-				 size_t count)
+static ssize_t sample_cpu_store(struct device *dev,
+				struct device_attribute *attr, const char *buf,
+				size_t count)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
-	unsigned int val;
-	int ret;
+	int cpu, ret;
 
-	ret = kstrtouint(buf, 10, &val);
+	ret = kstrtoint(buf, 10, &cpu);
 	if (ret)
 		return ret;
 
-	if (val < SIMTEMP_MIN_SAMPLING_MS || val > SIMTEMP_MAX_SAMPLING_MS)
+	/* -1 lets the timer and work run wherever they are scheduled */
+	if (cpu < -1 || (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu))))
 		return -EINVAL;
 
 	mutex_lock(&simtemp->config_lock);
-	simtemp->sampling_ms = val;
+	if (simtemp->enabled) {
+		ret = -EBUSY;
+	} else {
+		cancel_work_sync(&simtemp->sample_work);
+		simtemp->sample_cpu = cpu;
+	}
 	mutex_unlock(&simtemp->config_lock);
 
-	return count;
+	return ret ? ret : count;
 }
-static DEVICE_ATTR_RW(sampling_ms);
+static DEVICE_ATTR_RW(sample_cpu);
 
-static ssize_t threshold_mC_store(struct device *dev,
-				  struct device_attribute *attr,
-				  const char *buf, size_t count)
+static ssize_t filter_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
-	int val;
-	int ret;
 
-	ret = kstrtoint(buf, 10, &val);
-	if (ret)
-		return ret;
+	return sprintf(buf, "%s\n",
+		       simtemp_filter_names[simtemp_param(simtemp, filter)]);
+}
+
+static ssize_t filter_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	int filter, ret;
 
+	filter = sysfs_match_string(simtemp_filter_names, buf);
+	if (filter < 0)
+		return filter;
+
+	/* The producer drops its partial window when it sees the reset */
 	mutex_lock(&simtemp->config_lock);
-	simtemp->threshold_mC = val;
+	ret = simtemp_params_update(simtemp, filter, filter);
+	if (!ret)
+		WRITE_ONCE(simtemp->filter_reset, true);
 	mutex_unlock(&simtemp->config_lock);
 
-	return count;
+	return ret ? ret : count;
 }
-static DEVICE_ATTR_RW(threshold_mC);
+static DEVICE_ATTR_RW(filter);
 
-static ssize_t mode_store(struct device *dev, struct device_attribute *attr,
-			  const char *buf, size_t count)
+static ssize_t filter_window_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
 {
 	struct simtemp_device *simtemp = dev_get_drvdata(dev);
-	enum simtemp_mode mode;
 
-	if (sysfs_streq(buf, "normal"))
-		mode = SIMTEMP_MODE_NORMAL;
-	else if (sysfs_streq(buf, "noisy"))
-		mode = SIMTEMP_MODE_NOISY;
-	else if (sysfs_streq(buf, "ramp"))
-		mode = SIMTEMP_MODE_RAMP;
-	else
+	return sprintf(buf, "%u\n", simtemp_param(simtemp, filter_window));
+}
+
+static ssize_t filter_window_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct simtemp_device *simtemp = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (val < 1 || val > SIMTEMP_MAX_FILTER_WINDOW)
 		return -EINVAL;
 
 	mutex_lock(&simtemp->config_lock);
-	simtemp->mode = mode;
+	ret = simtemp_params_update(simtemp, filter_window, val);
+	if (!ret)
+		WRITE_ONCE(simtemp->filter_reset, true);
 	mutex_unlock(&simtemp->config_lock);
 
-	return count;
+	return ret ? ret : count;
 }
-static DEVICE_ATTR_RW(mode);
+static DEVICE_ATTR_RW(filter_window);
 
 static ssize_t enabled_store(struct device *dev, struct device_attribute *attr,
 			     const char *buf, size_t count)
@@ -476,15 +3185,10 @@ static ssize_t enabled_store(struct device *dev, struct device_attribute *attr,
 		return ret;
 
 	mutex_lock(&simtemp->config_lock);
-	if (val && !simtemp->enabled) {
-		simtemp->enabled = true;
-		hrtimer_start(&simtemp->timer,
-			      ms_to_ktime(simtemp->sampling_ms),
-			      HRTIMER_MODE_REL);
-	} else if (!val && simtemp->enabled) {
-		simtemp->enabled = false;
-		hrtimer_cancel(&simtemp->timer);
-	}
+	if (val)
+		simtemp_start(simtemp);
+	else if (simtemp->enabled)
+		simtemp_stop(simtemp);
 	mutex_unlock(&simtemp->config_lock);
 
 	return count;
@@ -492,9 +3196,18 @@ static ssize_t enabled_store(struct device *dev, struct device_attribute *attr,
 static DEVICE_ATTR_RW(enabled);
 
 static struct attribute *simtemp_attrs[] = {
-	&dev_attr_sampling_ms.attr, &dev_attr_threshold_mC.attr,
+	&dev_attr_sampling_ms.attr, &dev_attr_sampling_us.attr,
+	&dev_attr_burst.attr,	    &dev_attr_threshold_mC.attr,
 	&dev_attr_mode.attr,	    &dev_attr_stats.attr,
-	&dev_attr_enabled.attr,	    NULL,
+	&dev_attr_enabled.attr,	    &dev_attr_buffer_size.attr,
+	&dev_attr_overflow_policy.attr, &dev_attr_sample_context.attr,
+	&dev_attr_sample_cpu.attr,	&dev_attr_replay_loop.attr,
+	&dev_attr_replay_us.attr,	&dev_attr_replay_drain.attr,
+	&dev_attr_replay_firmware.attr, &dev_attr_filter.attr,
+	&dev_attr_filter_window.attr,	&dev_attr_hysteresis_mC.attr,
+	&dev_attr_temp.attr,		&dev_attr_stats_window.attr,
+	&dev_attr_window_stats.attr,	&dev_attr_timer_slack_us.attr,
+	&dev_attr_timer_align.attr,	NULL,
 };
 
 static const struct attribute_group simtemp_attr_group = {
@@ -513,16 +3226,143 @@ void simtemp_sysfs_cleanup(struct simtemp_device *simtemp)
 			   &simtemp_attr_group);
 }
 
+/*
+ * Sum one histogram over all CPUs and print its non-empty buckets as
+ * "low high count", 'high' being "inf" for the open-ended last bucket.
+ */
+static void simtemp_hist_show(struct seq_file *m, size_t offset)
+{
+	struct simtemp_device *simtemp = m->private;
+	unsigned long count[SIMTEMP_HIST_BUCKETS] = {};
+	const unsigned long *h;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		h = (void *)per_cpu_ptr(simtemp->hist, cpu) + offset;
+		for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++)
+			count[i] += READ_ONCE(h[i]);
+	}
+
+	for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++) {
+		if (!count[i])
+			continue;
+
+		seq_printf(m, "%llu ", i ? 1ULL << (i - 1) : 0);
+		if (i == SIMTEMP_HIST_BUCKETS - 1)
+			seq_puts(m, "inf");
+		else
+			seq_printf(m, "%llu", (1ULL << i) - 1);
+		seq_printf(m, " %lu\n", count[i]);
+	}
+}
+
+static int timer_jitter_ns_show(struct seq_file *m, void *unused)
+{
+	simtemp_hist_show(m, offsetof(struct simtemp_hist, jitter));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(timer_jitter_ns);
+
+static int read_latency_ns_show(struct seq_file *m, void *unused)
+{
+	simtemp_hist_show(m, offsetof(struct simtemp_hist, latency));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(read_latency_ns);
+
+static int ring_occupancy_show(struct seq_file *m, void *unused)
+{
+	simtemp_hist_show(m, offsetof(struct simtemp_hist, occupancy));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ring_occupancy);
+
+/* Any write clears all histograms; a racing update may survive it */
+static ssize_t simtemp_hist_reset_write(struct file *file,
+					const char __user *buf, size_t count,
+					loff_t *ppos)
+{
+	struct simtemp_device *simtemp = file->private_data;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(simtemp->hist, cpu), 0,
+		       sizeof(struct simtemp_hist));
+
+	return count;
+}
+
+static const struct file_operations simtemp_hist_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = simtemp_hist_reset_write,
+	.llseek = noop_llseek,
+};
+
+static void simtemp_debugfs_remove(void *data)
+{
+	struct simtemp_device *simtemp = data;
+
+	debugfs_remove_recursive(simtemp->debugfs_dir);
+}
+
+/* Debug only: like any debugfs user, creation failures are not fatal */
+static int simtemp_debugfs_init(struct simtemp_device *simtemp)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(simtemp->name, simtemp_debugfs_root);
+	simtemp->debugfs_dir = dir;
+
+	debugfs_create_bool("hist_enable", 0600, dir, &simtemp->hist_enabled);
+	debugfs_create_file("hist_reset", 0200, dir, simtemp,
+			    &simtemp_hist_reset_fops);
+	debugfs_create_file("timer_jitter_ns", 0400, dir, simtemp,
+			    &timer_jitter_ns_fops);
+	debugfs_create_file("read_latency_ns", 0400, dir, simtemp,
+			    &read_latency_ns_fops);
+	debugfs_create_file("ring_occupancy", 0400, dir, simtemp,
+			    &ring_occupancy_fops);
+
+	return devm_add_action_or_reset(&simtemp->pdev->dev,
+					simtemp_debugfs_remove, simtemp);
+}
+
 static int simtemp_parse_dt(struct simtemp_device *simtemp,
 			    struct device_node *np)
 {
+	const char *policy;
+	u32 period_ms, cpu, slack;
 	int ret;
 
-	ret = of_property_read_u32(np, "sampling-ms", &simtemp->dt_sampling_ms);
+	/* sampling-us takes precedence over the coarser sampling-ms */
+	ret = of_property_read_u32(np, "sampling-us", &simtemp->dt_sampling_us);
+	if (!ret) {
+		if (simtemp->dt_sampling_us < SIMTEMP_MIN_SAMPLING_US ||
+		    simtemp->dt_sampling_us > SIMTEMP_MAX_SAMPLING_US)
+			ret = -ERANGE;
+	} else if (!of_property_read_u32(np, "sampling-ms", &period_ms)) {
+		if (period_ms >= SIMTEMP_MIN_SAMPLING_MS &&
+		    period_ms <= SIMTEMP_MAX_SAMPLING_MS) {
+			simtemp->dt_sampling_us = period_ms * USEC_PER_MSEC;
+			ret = 0;
+		}
+	}
+	if (ret) {
+		simtemp->dt_sampling_us =
+			SIMTEMP_DEFAULT_SAMPLING_MS * USEC_PER_MSEC;
+		simtemp_info(simtemp, "Using default sampling period: %u us\n",
+			     simtemp->dt_sampling_us);
+	}
+
+	ret = of_property_read_u32(np, "burst", &simtemp->dt_burst);
 	if (ret) {
-		simtemp->dt_sampling_ms = SIMTEMP_DEFAULT_SAMPLING_MS;
-		simtemp_info(simtemp, "Using default sampling period: %u ms\n",
-			     simtemp->dt_sampling_ms);
+		simtemp->dt_burst = 1;
+	} else if (simtemp->dt_burst < 1 ||
+		   simtemp->dt_burst > SIMTEMP_MAX_BURST) {
+		simtemp_warn(simtemp, "Invalid burst %u, using 1\n",
+			     simtemp->dt_burst);
+		simtemp->dt_burst = 1;
 	}
 
 	ret = of_property_read_s32(np, "threshold-mC",
@@ -533,8 +3373,102 @@ static int simtemp_parse_dt(struct simtemp_device *simtemp,
 			     simtemp->dt_threshold_mC);
 	}
 
-	simtemp_info(simtemp, "DT config: sampling=%u ms, threshold=%d mC\n",
-		     simtemp->dt_sampling_ms, simtemp->dt_threshold_mC);
+	ret = of_property_read_u32(np, "buffer-size", &simtemp->dt_buffer_size);
+	if (ret) {
+		simtemp->dt_buffer_size = SIMTEMP_DEFAULT_BUFFER_SIZE;
+	} else if (simtemp->dt_buffer_size < SIMTEMP_MIN_BUFFER_SIZE ||
+		   simtemp->dt_buffer_size > SIMTEMP_MAX_BUFFER_SIZE) {
+		simtemp_warn(simtemp, "Invalid buffer-size %u, using %u\n",
+			     simtemp->dt_buffer_size,
+			     SIMTEMP_DEFAULT_BUFFER_SIZE);
+		simtemp->dt_buffer_size = SIMTEMP_DEFAULT_BUFFER_SIZE;
+	} else if (!is_power_of_2(simtemp->dt_buffer_size)) {
+		simtemp->dt_buffer_size =
+			roundup_pow_of_two(simtemp->dt_buffer_size);
+		simtemp_info(simtemp, "Rounded buffer-size up to %u\n",
+			     simtemp->dt_buffer_size);
+	}
+
+	simtemp->sample_cpu = -1;
+	if (!of_property_read_u32(np, "sample-cpu", &cpu)) {
+		if (cpu < nr_cpu_ids && cpu_possible(cpu))
+			simtemp->sample_cpu = cpu;
+		else
+			simtemp_warn(simtemp, "Invalid sample-cpu %u, ignoring\n",
+				     cpu);
+	}
+
+	simtemp->dt_timer_slack_us = min_t(u32, timer_slack_us,
+					   SIMTEMP_MAX_TIMER_SLACK_US);
+	if (!of_property_read_u32(np, "timer-slack-us", &slack)) {
+		if (slack <= SIMTEMP_MAX_TIMER_SLACK_US)
+			simtemp->dt_timer_slack_us = slack;
+		else
+			simtemp_warn(simtemp,
+				     "Invalid timer-slack-us %u, ignoring\n",
+				     slack);
+	}
+	simtemp->dt_timer_align = timer_align ||
+				  of_property_read_bool(np, "timer-align");
+
+	/* Opts the node out of the module-wide coalescing defaults */
+	if (of_property_read_bool(np, "latency-critical")) {
+		simtemp->dt_timer_slack_us = 0;
+		simtemp->dt_timer_align = false;
+	}
+
+	ret = of_property_read_string(np, "overflow-policy", &policy);
+	if (!ret) {
+		ret = match_string(simtemp_overflow_names,
+				   ARRAY_SIZE(simtemp_overflow_names), policy);
+		if (ret < 0)
+			simtemp_warn(simtemp,
+				     "Unknown overflow-policy \"%s\", using default\n",
+				     policy);
+		else
+			simtemp->dt_overflow_policy = ret;
+	}
+
+	simtemp_info(simtemp,
+		     "DT config: sampling=%u us, threshold=%d mC, buffer=%u\n",
+		     simtemp->dt_sampling_us, simtemp->dt_threshold_mC,
+		     simtemp->dt_buffer_size);
+
+	return 0;
+}
+
+static void simtemp_release_id(void *data)
+{
+	struct simtemp_device *simtemp = data;
+
+	ida_free(&simtemp_ida, simtemp->id);
+}
+
+/*
+ * Every instance gets a distinct simtemp<N>, unless its DT node asks for a
+ * specific name through "device-name".
+ */
+static int simtemp_name_device(struct simtemp_device *simtemp,
+			       struct device_node *np)
+{
+	const char *name;
+	int ret;
+
+	ret = ida_alloc(&simtemp_ida, GFP_KERNEL);
+	if (ret < 0)
+		return ret;
+	simtemp->id = ret;
+
+	ret = devm_add_action_or_reset(simtemp->dev, simtemp_release_id,
+				       simtemp);
+	if (ret)
+		return ret;
+
+	if (np && !of_property_read_string(np, "device-name", &name))
+		strscpy(simtemp->name, name, sizeof(simtemp->name));
+	else
+		snprintf(simtemp->name, sizeof(simtemp->name), "simtemp%d",
+			 simtemp->id);
 
 	return 0;
 }
@@ -542,45 +3476,109 @@ static int simtemp_parse_dt(struct simtemp_device *simtemp,
 static int simtemp_probe(struct platform_device *pdev)
 {
 	struct simtemp_device *simtemp;
+	struct simtemp_params *params;
+	struct simtemp_ring *ring;
 	struct device_node *np = pdev->dev.of_node;
 	int ret;
 
-	simtemp = devm_kzalloc(&pdev->dev, sizeof(*simtemp), GFP_KERNEL);
+	/*
+	 * Not devm: a file opened before an unbind keeps this, and everything
+	 * hanging off it, until it is closed. Added first, the put runs after
+	 * every other devm action.
+	 */
+	simtemp = kzalloc(sizeof(*simtemp), GFP_KERNEL);
 	if (!simtemp)
 		return -ENOMEM;
 
+	kref_init(&simtemp->ref);
 	simtemp->pdev = pdev;
-	simtemp->dev = &pdev->dev;
+	simtemp->dev = get_device(&pdev->dev);
 	platform_set_drvdata(pdev, simtemp);
 
+	ret = devm_add_action_or_reset(&pdev->dev, simtemp_put, simtemp);
+	if (ret)
+		return ret;
+
 	if (np) {
 		ret = simtemp_parse_dt(simtemp, np);
 		if (ret)
 			return ret;
 	} else {
-		simtemp->dt_sampling_ms = SIMTEMP_DEFAULT_SAMPLING_MS;
+		simtemp->dt_sampling_us =
+			SIMTEMP_DEFAULT_SAMPLING_MS * USEC_PER_MSEC;
 		simtemp->dt_threshold_mC = SIMTEMP_DEFAULT_THRESHOLD_MC;
+		simtemp->dt_buffer_size = SIMTEMP_DEFAULT_BUFFER_SIZE;
+		simtemp->dt_burst = 1;
+		simtemp->dt_timer_slack_us = min_t(u32, timer_slack_us,
+						   SIMTEMP_MAX_TIMER_SLACK_US);
+		simtemp->dt_timer_align = timer_align;
 	}
 
-	simtemp->sampling_ms = simtemp->dt_sampling_ms;
-	simtemp->threshold_mC = simtemp->dt_threshold_mC;
-	simtemp->mode = SIMTEMP_MODE_NORMAL;
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return -ENOMEM;
+
+	params->sampling_us = simtemp->dt_sampling_us;
+	params->burst = simtemp->dt_burst;
+	params->period = ns_to_ktime((u64)params->sampling_us *
+				     params->burst * NSEC_PER_USEC);
+	params->threshold_mC = simtemp->dt_threshold_mC;
+	params->mode = SIMTEMP_MODE_NORMAL;
+	params->overflow_policy = simtemp->dt_overflow_policy;
+	params->filter = SIMTEMP_FILTER_NONE;
+	params->filter_window = 1;
+	params->replay_loop = true;
+	params->timer_slack_us = simtemp->dt_timer_slack_us;
+	params->timer_align = simtemp->dt_timer_align;
+	RCU_INIT_POINTER(simtemp->params, params);
+
 	simtemp->enabled = false;
 	simtemp->last_temp_mC = SIMTEMP_BASE_TEMP_MC;
+	simtemp->threshold_crossed =
+		simtemp->last_temp_mC >= params->threshold_mC;
+	prandom_seed_state(&simtemp->rnd, get_random_u64());
 
 	mutex_init(&simtemp->config_lock);
-	spin_lock_init(&simtemp->buffer_lock);
-	init_waitqueue_head(&simtemp->wait_queue);
+	mutex_init(&simtemp->ring_lock);
+	mutex_init(&simtemp->stats_lock);
+	spin_lock_init(&simtemp->readers_lock);
+	spin_lock_init(&simtemp->window_lock);
+	INIT_LIST_HEAD(&simtemp->readers);
 	atomic_set(&simtemp->open_count, 0);
+	atomic_set(&simtemp->ring_maps, 0);
+
+	simtemp->stats = alloc_percpu(struct simtemp_stats);
+	if (!simtemp->stats)
+		return -ENOMEM;
+
+	simtemp->hist = alloc_percpu(struct simtemp_hist);
+	if (!simtemp->hist)
+		return -ENOMEM;
 
-	INIT_KFIFO(simtemp->sample_buffer);
+	ring = simtemp_ring_alloc(simtemp->dt_buffer_size, 0);
+	if (!ring)
+		return -ENOMEM;
+	RCU_INIT_POINTER(simtemp->ring, ring);
 
 	hrtimer_init(&simtemp->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	simtemp->timer.function = simtemp_timer_callback;
 	INIT_WORK(&simtemp->sample_work, simtemp_sample_work);
 
+	ret = simtemp_name_device(simtemp, np);
+	if (ret)
+		return ret;
+
+	/* Kept off the shared system workqueue for predictable latency */
+	simtemp->wq = alloc_workqueue("%s", WQ_HIGHPRI, 0, simtemp->name);
+	if (!simtemp->wq)
+		return -ENOMEM;
+
+	ret = simtemp_debugfs_init(simtemp);
+	if (ret)
+		return ret;
+
 	simtemp->misc_dev.minor = MISC_DYNAMIC_MINOR;
-	simtemp->misc_dev.name = "simtemp";
+	simtemp->misc_dev.name = simtemp->name;
 	simtemp->misc_dev.fops = &simtemp_fops;
 	simtemp->misc_dev.parent = &pdev->dev;
 
@@ -602,9 +3600,8 @@ static int simtemp_probe(struct platform_device *pdev)
 		return ret;
 	}
 
-	g_simtemp_dev = simtemp;
-
-	dev_info(&pdev->dev, "NXP simtemp driver probed successfully\n");
+	dev_info(&pdev->dev, "NXP simtemp driver probed as /dev/%s\n",
+		 simtemp->name);
 
 	return 0;
 }
@@ -612,7 +3609,7 @@ static int simtemp_probe(struct platform_device *pdev)
 static void simtemp_remove(struct platform_device *pdev)
 {
 	struct simtemp_device *simtemp = platform_get_drvdata(pdev);
-	unsigned long flags;
+	struct simtemp_reader *reader;
 
 	dev_info(&pdev->dev, "Removing NXP simtemp driver...\n");
 
@@ -622,22 +3619,26 @@ static void simtemp_remove(struct platform_device *pdev)
 	/* Step 2: Unregister device to prevent new opens */
 	misc_deregister(&simtemp->misc_dev);
 
-	/* Step 3: Stop the timer (prevents new work from being queued) */
+	/*
+	 * Step 3: Stop the timer (prevents new work from being queued). Files
+	 * still open get -ENODEV from now on, so none of them can restart it.
+	 */
+	mutex_lock(&simtemp->config_lock);
+	WRITE_ONCE(simtemp->gone, true);
+	WRITE_ONCE(simtemp->enabled, false);
 	hrtimer_cancel(&simtemp->timer);
+	mutex_unlock(&simtemp->config_lock);
 
-	/* Step 4: Mark as disabled and wake up any waiters */
-	spin_lock_irqsave(&simtemp->buffer_lock, flags);
-	simtemp->enabled = false;
-	spin_unlock_irqrestore(&simtemp->buffer_lock, flags);
+	/* Step 4: Wake up any waiters, they see 'gone' and return */
 
-	wake_up_interruptible_all(&simtemp->wait_queue);
+	rcu_read_lock();
+	list_for_each_entry_rcu(reader, &simtemp->readers, node)
+		wake_up_interruptible_all(&reader->wait);
+	rcu_read_unlock();
 
 	/* Step 5: Cancel pending work (may sleep, but safe now) */
 	cancel_work_sync(&simtemp->sample_work);
 
-	/* Step 6: Final cleanup */
-	g_simtemp_dev = NULL;
-
 	dev_info(&pdev->dev, "NXP simtemp driver removed successfully\n");
 }
 
@@ -656,51 +3657,84 @@ static struct platform_driver simtemp_driver = {
 	},
 };
 
-static struct platform_device *simtemp_pdev;
+static struct platform_device *simtemp_pdevs[SIMTEMP_MAX_DEVICES];
 
 static void simtemp_device_release(struct device *dev)
 {
 	/* Nothing to do */
 }
 
+static void simtemp_remove_devices(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(simtemp_pdevs); i++) {
+		if (simtemp_pdevs[i])
+			platform_device_unregister(simtemp_pdevs[i]);
+		simtemp_pdevs[i] = NULL;
+	}
+}
+
 static int __init simtemp_init(void)
 {
+	struct platform_device *pdev;
+	unsigned int i;
 	int ret;
 
 	pr_info("NXP Simulated Temperature Sensor Driver Initializing\n");
 
+	simtemp_build_waves();
+
+	simtemp_debugfs_root = debugfs_create_dir("simtemp", NULL);
+
 	ret = platform_driver_register(&simtemp_driver);
 	if (ret) {
 		pr_err("nxp-simtemp: Failed to register platform driver: %d\n",
 		       ret);
+		debugfs_remove_recursive(simtemp_debugfs_root);
 		return ret;
 	}
 
-	simtemp_pdev = platform_device_alloc("nxp-simtemp", -1);
-	if (!simtemp_pdev) {
-		platform_driver_unregister(&simtemp_driver);
-		return -ENOMEM;
+	if (nr_devices > SIMTEMP_MAX_DEVICES) {
+		pr_warn("nxp-simtemp: nr_devices=%u too large, using %d\n",
+			nr_devices, SIMTEMP_MAX_DEVICES);
+		nr_devices = SIMTEMP_MAX_DEVICES;
 	}
 
-	simtemp_pdev->dev.release = simtemp_device_release;
+	for (i = 0; i < nr_devices; i++) {
+		pdev = platform_device_alloc("nxp-simtemp", i);
+		if (!pdev) {
+			ret = -ENOMEM;
+			goto err_devices;
+		}
 
-	ret = platform_device_add(simtemp_pdev);
-	if (ret) {
-		platform_device_put(simtemp_pdev);
-		platform_driver_unregister(&simtemp_driver);
-		return ret;
+		pdev->dev.release = simtemp_device_release;
+
+		ret = platform_device_add(pdev);
+		if (ret) {
+			platform_device_put(pdev);
+			goto err_devices;
+		}
+
+		simtemp_pdevs[i] = pdev;
 	}
 
-	pr_info("nxp-simtemp: Module loaded successfully\n");
+	pr_info("nxp-simtemp: Module loaded successfully (%u devices)\n",
+		nr_devices);
 	return 0;
+
+err_devices:
+	simtemp_remove_devices();
+	platform_driver_unregister(&simtemp_driver);
+	debugfs_remove_recursive(simtemp_debugfs_root);
+	return ret;
 }
 
 static void __exit simtemp_exit(void)
 {
-	if (simtemp_pdev)
-		platform_device_unregister(simtemp_pdev);
-
+	simtemp_remove_devices();
 	platform_driver_unregister(&simtemp_driver);
+	debugfs_remove_recursive(simtemp_debugfs_root);
 
 	pr_info("nxp-simtemp: Module unloaded\n");
 }
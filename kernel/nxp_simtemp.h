@@ -11,85 +11,336 @@
 #include <linux/device.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
-#include <linux/kfifo.h>
 #include <linux/wait.h>
 #include <linux/atomic.h>
+#include <linux/kref.h>
+#include <linux/percpu.h>
+#include <linux/prandom.h>
 #include <linux/miscdevice.h>
 #include <linux/platform_device.h>
 #include <linux/hrtimer.h>
 #include <linux/workqueue.h>
 
-struct simtemp_device;
+#include "nxp_simtemp_ioctl.h"
 
-struct simtemp_sample {
-	__u64 timestamp_ns; /* monotonic timestamp */
-	__s32 temp_mC; /* milli-degree Celsius (e.g., 44123 = 44.123 °C) */
-	__u32 flags; /* bit0=NEW_SAMPLE, bit1=THRESHOLD_CROSSED */
-} __packed;
+struct simtemp_device;
 
-/* Flag definitions */
-#define SIMTEMP_FLAG_NEW_SAMPLE BIT(0)
-#define SIMTEMP_FLAG_THRESHOLD_CROSSED BIT(1)
+/* Buffer size (number of samples, must be a power of two) */
+#define SIMTEMP_DEFAULT_BUFFER_SIZE 1024
+#define SIMTEMP_MIN_BUFFER_SIZE 16
+#define SIMTEMP_MAX_BUFFER_SIZE (1U << 20) /* 16 MiB of samples */
 
-/* Buffer size */
-#define SIMTEMP_BUFFER_SIZE 64
+/* Samples staged per bounce-buffer pass in read() */
+#define SIMTEMP_READ_CHUNK (PAGE_SIZE / sizeof(struct simtemp_sample))
 
 enum simtemp_mode {
 	SIMTEMP_MODE_NORMAL = 0,
 	SIMTEMP_MODE_NOISY,
 	SIMTEMP_MODE_RAMP,
+	SIMTEMP_MODE_REPLAY, /* play back a user-supplied trace */
 	SIMTEMP_MODE_MAX
 };
 
+/* What the producer gives up when a reader has not kept up */
+enum simtemp_overflow_policy {
+	SIMTEMP_OVERFLOW_OVERWRITE_OLDEST = 0,
+	SIMTEMP_OVERFLOW_DROP_NEWEST,
+	SIMTEMP_OVERFLOW_MAX
+};
+
+/* Where each timer tick produces its sample */
+enum simtemp_sample_context {
+	SIMTEMP_CONTEXT_HRTIMER = 0, /* directly in the timer callback */
+	SIMTEMP_CONTEXT_WORKQUEUE, /* deferred to the system workqueue */
+	SIMTEMP_CONTEXT_MAX
+};
+
+/* Filter stage between sample generation and the ring */
+enum simtemp_filter {
+	SIMTEMP_FILTER_NONE = 0, /* every raw sample */
+	SIMTEMP_FILTER_DECIMATE, /* last raw sample of each window */
+	SIMTEMP_FILTER_BOXCAR, /* mean of each window */
+	SIMTEMP_FILTER_EMA, /* exponential average, alpha = 1/window */
+	SIMTEMP_FILTER_MINMAX, /* minimum and maximum of each window */
+	SIMTEMP_FILTER_MAX
+};
+
+/* Per-window accumulator of the filter stage, producer only */
+struct simtemp_filter_state {
+	u32 count; /* raw samples in the current window */
+	u8 flags; /* OR of the raw samples' flags */
+	s64 sum; /* BOXCAR */
+	s64 ema; /* EMA, in 1/256 mC */
+	bool ema_valid;
+	struct simtemp_sample min, max; /* MINMAX */
+};
+
+/*
+ * Page-backed sample ring shared with user space through mmap(). The
+ * header page and slots live in a single vmalloc_user() area. 'head',
+ * 'tail' and 'capacity' are kernel-private copies of the header fields;
+ * the shared page is never read back. The device publishes its ring
+ * through RCU so it can be replaced by a resize.
+ */
+struct simtemp_ring {
+	struct simtemp_ring_header *hdr;
+	struct simtemp_sample *slots;
+	size_t size; /* bytes, header page included */
+	u32 capacity;
+	u32 mask;
+	u32 head; /* next index to be written */
+	u32 tail; /* oldest index still held */
+	u32 generation; /* bumped on every resize and flush */
+	u32 resync_head; /* head of the previous generation when it ended */
+	u32 last_event; /* index after the newest threshold crossing */
+};
+
+/*
+ * Replay trace of temp_mC values, uploaded through write() or loaded with
+ * request_firmware(). The active trace is published through RCU.
+ */
+struct simtemp_trace {
+	struct rcu_head rcu;
+	u32 len; /* valid entries */
+	u32 capacity; /* allocated entries */
+	s32 mC[];
+};
+
+/*
+ * Rolling aggregates over the last 'size' raw samples, updated in O(1) per
+ * sample: sums are adjusted as a sample enters and leaves, and min/max
+ * come from monotonic queues of (seq, value) whose head is the current
+ * extreme. The queues are free-running indices masked with 'mask'.
+ */
+struct simtemp_window_entry {
+	u32 seq;
+	s32 mC;
+};
+
+struct simtemp_window {
+	u32 size; /* samples covered */
+	u32 count; /* samples held, up to size */
+	u32 pos; /* next slot of vals[] */
+	u32 seq; /* samples pushed so far */
+	u32 mask; /* queue capacity - 1, capacity >= size */
+	u32 min_head, min_tail;
+	u32 max_head, max_tail;
+	s64 sum;
+	u64 sum_sq;
+	struct simtemp_window_entry *min_q; /* increasing */
+	struct simtemp_window_entry *max_q; /* decreasing */
+	s32 vals[]; /* the last 'size' samples, oldest at 'pos' once full */
+};
+
+/* A compact-format reader resyncs at least this often, in records */
+#define SIMTEMP_COMPACT_SYNC_INTERVAL 1024
+
+/*
+ * Encoder state of a SIMTEMP_FORMAT_COMPACT reader: the previous sample
+ * as the consumer will have decoded it, which the next record is relative
+ * to. Keeping the decoded rather than the real timestamp stops rounding
+ * from accumulating over a run of records.
+ */
+struct simtemp_compact_state {
+	u8 *buf; /* PAGE_SIZE staging buffer */
+	u64 timestamp_ns;
+	s32 temp_mC;
+	u32 period_ns; /* from the last sync frame */
+	u32 records; /* since the last sync frame */
+	bool resync; /* send the next sample as a sync frame */
+};
+
+/* Outcome of one bounce-buffer pass in read() */
+struct simtemp_fetch {
+	u32 cursor; /* reader cursor once the pass is committed */
+	u32 generation; /* ring the cursor refers to */
+	u32 skip; /* leading bounce entries invalidated by the producer */
+	u32 lost; /* samples overwritten before the pass started */
+};
+
+/*
+ * Per-open consumer state, stored in file->private_data. Every reader
+ * walks the shared ring with its own cursor, so concurrent consumers each
+ * see the full stream; a reader that falls more than a ring's worth
+ * behind is moved forward and the skipped samples are counted as overruns.
+ * So are the samples a flush or resize discarded before this reader got
+ * to them, provided it read since the one before: a reader that sleeps
+ * through two in a row resumes at the new tail with nothing counted.
+ */
+struct simtemp_reader {
+	struct simtemp_device *simtemp;
+	struct list_head node; /* on simtemp->readers */
+	struct mutex lock; /* serialises read() calls on this file */
+	wait_queue_head_t wait;
+	u32 cursor; /* next index to hand out */
+	u32 ring_gen; /* generation of the ring 'cursor' refers to */
+	u64 overruns;
+	u32 watermark; /* wake once this many samples are queued */
+	u32 timeout_ms; /* ...or once the oldest is this old, 0 = never */
+	bool streaming; /* has called read(), holds back drop-newest */
+	bool mapped; /* consumes through mmap(), cursor lives in user space */
+	bool gap; /* flag the next sample handed out as SIMTEMP_FLAG_OVERRUN */
+	bool events_only; /* SIMTEMP_READ_EVENTS_ONLY */
+	u32 alert_ack; /* alert_seq at the last SIMTEMP_IOC_GET_ALERT */
+	struct eventfd_ctx __rcu *alert_efd; /* signalled on each crossing */
+	struct simtemp_sample *bounce; /* SIMTEMP_READ_CHUNK entries */
+	u32 format; /* SIMTEMP_FORMAT_* */
+	struct simtemp_compact_state compact;
+	struct simtemp_trace *upload; /* written trace, installed on close */
+	struct rcu_head rcu;
+};
+
+/*
+ * Event counters. Each CPU bumps its own copy with this_cpu_*() so hot
+ * paths never share a cache line; readers sum them in
+ * simtemp_stats_snapshot().
+ */
 struct simtemp_stats {
 	unsigned long updates;
 	unsigned long alerts;
 	unsigned long read_calls;
 	unsigned long poll_calls;
-	int last_error;
+	unsigned long dropped;
+};
+
+/*
+ * Sampling parameters. The producer reads one immutable snapshot per tick
+ * through simtemp->params; writers hold config_lock, publish a modified
+ * copy and free the old one after a grace period, so an update is seen
+ * entirely or not at all.
+ */
+struct simtemp_params {
+	u32 sampling_us;
+	u32 burst; /* samples generated per timer tick */
+	ktime_t period; /* timer period, derived in simtemp_params_commit() */
+	s32 threshold_mC;
+	u32 hysteresis_mC; /* dead band below the threshold for re-arming */
+	enum simtemp_mode mode;
+	enum simtemp_overflow_policy overflow_policy;
+	enum simtemp_filter filter;
+	u32 filter_window; /* raw samples per filtered output */
+	u32 replay_us; /* replay period, 0 = follow sampling_us */
+	bool replay_loop; /* restart at the end instead of stopping */
+	bool replay_drain; /* refill as fast as readers consume */
+	u32 timer_slack_us; /* expiry window the timer may be coalesced in */
+	bool timer_align; /* expire on the CLOCK_MONOTONIC period grid */
+	struct rcu_head rcu;
+};
+
+#define simtemp_stat_inc(simtemp, field) this_cpu_inc((simtemp)->stats->field)
+#define simtemp_stat_add(simtemp, field, n) \
+	this_cpu_add((simtemp)->stats->field, n)
+
+/*
+ * Hot-path histograms for debugfs, log2 buckets: bucket 0 counts zero and
+ * bucket i counts values in [2^(i-1), 2^i), the last one everything above.
+ * Per-CPU like the stats and only updated while hist_enabled is set.
+ */
+#define SIMTEMP_HIST_BUCKETS 32
+
+struct simtemp_hist {
+	unsigned long jitter[SIMTEMP_HIST_BUCKETS]; /* timer lateness, ns */
+	unsigned long latency[SIMTEMP_HIST_BUCKETS]; /* timestamp to read(), ns */
+	unsigned long occupancy[SIMTEMP_HIST_BUCKETS]; /* lag after a tick */
 };
 
+#define simtemp_hist_bucket(v) \
+	((v) ? min_t(u32, fls64(v), SIMTEMP_HIST_BUCKETS - 1) : 0)
+#define simtemp_hist_inc(simtemp, field, v) \
+	this_cpu_inc((simtemp)->hist->field[simtemp_hist_bucket(v)])
+
 /* Main device structure */
 struct simtemp_device {
 	struct platform_device *pdev;
 	struct miscdevice misc_dev;
 	struct device *dev;
+	int id; /* instance number, from simtemp_ida */
+	char name[32]; /* misc device node name */
 
 	struct hrtimer timer;
 	struct work_struct sample_work;
+	struct workqueue_struct *wq; /* WQ_HIGHPRI, runs sample_work */
+	int sample_cpu; /* CPU the timer and work are pinned to, -1 = any */
 
-	unsigned int sampling_ms;
-	s32 threshold_mC;
-	enum simtemp_mode mode;
+	struct simtemp_params __rcu *params; /* protected by config_lock */
+	enum simtemp_sample_context sample_context;
+	bool filter_reset; /* restart the window at the next sample */
+	struct simtemp_filter_state filter_state;
 
-	u32 dt_sampling_ms;
+	u32 dt_sampling_us;
+	u32 dt_burst;
 	s32 dt_threshold_mC;
+	u32 dt_buffer_size;
+	enum simtemp_overflow_policy dt_overflow_policy;
+	u32 dt_timer_slack_us;
+	bool dt_timer_align;
+
+	u32 wave_phase; /* index into the mode's waveform table */
+	struct rnd_state rnd; /* noise source, producer only */
+
+	struct simtemp_trace __rcu *trace; /* protected by config_lock */
+	u32 replay_pos; /* next trace entry, producer only */
+	bool replay_rewind; /* restart the trace at the next sample */
 
 	s32 last_temp_mC;
 	bool enabled;
-	bool threshold_crossed;
+	bool threshold_crossed; /* above the threshold, producer only */
+	u32 alert_seq; /* threshold crossings so far, producer only */
+	bool overflow_gap; /* samples were dropped since the last push */
+
+	struct simtemp_stats __percpu *stats;
+	struct simtemp_stats stats_base; /* totals at the last reset */
+	struct mutex stats_lock; /* serialises snapshots against reset */
+	int last_error;
 
-	struct simtemp_stats stats;
+	struct simtemp_window *window; /* NULL while disabled */
+	spinlock_t window_lock; /* serialises the producer and snapshots */
 
-	DECLARE_KFIFO(sample_buffer, struct simtemp_sample,
-		      SIMTEMP_BUFFER_SIZE);
-	spinlock_t buffer_lock;
+	struct simtemp_hist __percpu *hist;
+	bool hist_enabled; /* debugfs switch for the histograms */
+	struct dentry *debugfs_dir;
 
-	wait_queue_head_t wait_queue;
+	struct simtemp_ring __rcu *ring;
+	struct mutex ring_lock; /* serialises ring replacement against mmap() */
+	atomic_t ring_maps; /* live mappings of the current ring */
+
+	struct list_head readers; /* RCU list of open files */
+	spinlock_t readers_lock; /* serialises updates of the readers list */
 
 	struct mutex config_lock;
 	atomic_t open_count;
+	bool gone; /* unbound with files still open, protected by config_lock */
+	struct kref ref; /* held by the bound device and by every open file */
 };
 
 #define SIMTEMP_DEFAULT_SAMPLING_MS 100
 #define SIMTEMP_DEFAULT_THRESHOLD_MC 45000 /* 45.0 °C */
 #define SIMTEMP_MIN_SAMPLING_MS 1
 #define SIMTEMP_MAX_SAMPLING_MS 10000
+#define SIMTEMP_MIN_SAMPLING_US 10 /* 100 kHz */
+#define SIMTEMP_MAX_SAMPLING_US (SIMTEMP_MAX_SAMPLING_MS * USEC_PER_MSEC)
+#define SIMTEMP_MAX_BURST 64 /* samples per timer tick */
+#define SIMTEMP_MAX_DEVICES 64
 
 #define SIMTEMP_BASE_TEMP_MC 25000 /* 25.0 °C */
 #define SIMTEMP_TEMP_RANGE_MC 30000 /* ±30.0 °C */
 #define SIMTEMP_NOISE_RANGE_MC 2000 /* ±2.0 °C */
 
+/* Waveform table lengths, in samples per period */
+#define SIMTEMP_SINE_STEPS 20
+#define SIMTEMP_RAMP_STEPS 200
+#define SIMTEMP_WAVE_MAX_LEN SIMTEMP_RAMP_STEPS
+
+#define SIMTEMP_MIN_TRACE_LEN 1024 /* first allocation of an upload */
+#define SIMTEMP_MAX_TRACE_LEN (1U << 22) /* 16 MiB of temp_mC values */
+#define SIMTEMP_DRAIN_BATCH 4096 /* samples per drain-mode work run */
+
+#define SIMTEMP_MAX_FILTER_WINDOW 65536
+#define SIMTEMP_MAX_STATS_WINDOW 65536 /* samples */
+#define SIMTEMP_MAX_HYSTERESIS_MC 100000 /* 100 °C */
+#define SIMTEMP_MAX_TIMER_SLACK_US 1000000 /* 1 s, still capped to a period */
+#define SIMTEMP_FILTER_MAX_OUT 2 /* samples one window can yield */
+
 int simtemp_generate_sample(struct simtemp_device *simtemp);
 int simtemp_sysfs_init(struct simtemp_device *simtemp);
 void simtemp_sysfs_cleanup(struct simtemp_device *simtemp);
@@ -101,6 +352,9 @@ void simtemp_sample_work(struct work_struct *work);
 #define simtemp_warn(simtemp, fmt, args...) \
 	dev_warn((simtemp)->dev, fmt, ##args)
 
+#define simtemp_warn_ratelimited(simtemp, fmt, args...) \
+	dev_warn_ratelimited((simtemp)->dev, fmt, ##args)
+
 #define simtemp_info(simtemp, fmt, args...) \
 	dev_info((simtemp)->dev, fmt, ##args)
 
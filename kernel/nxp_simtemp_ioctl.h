@@ -13,13 +13,95 @@
 
 #define SIMTEMP_IOC_MAGIC 'S'
 
+struct simtemp_sample {
+	__u64 timestamp_ns; /* monotonic timestamp */
+	__s32 temp_mC; /* milli-degree Celsius (e.g., 44123 = 44.123 °C) */
+	__u32 flags; /* bit0=NEW_SAMPLE, bit1=THRESHOLD_CROSSED, bit2=OVERRUN */
+} __attribute__((packed));
+
+/* Flag definitions */
+#define SIMTEMP_FLAG_NEW_SAMPLE (1U << 0)
+#define SIMTEMP_FLAG_THRESHOLD_CROSSED (1U << 1)
+/* Samples were lost between this one and the previous one delivered */
+#define SIMTEMP_FLAG_OVERRUN (1U << 2)
+
+/*
+ * Shared ring exported through mmap() on the character device.
+ *
+ * The mapping is read-only and starts with one header page followed by
+ * 'capacity' sample slots at 'data_offset'. 'head' and 'tail' are
+ * free-running indices; sample i lives in slot (i & (capacity - 1)) and
+ * the ring holds samples [tail, head). The driver recycles the oldest slot
+ * when the ring is full, so each consumer keeps its own cursor:
+ *
+ *   head = load_acquire(&hdr->head);
+ *   if (head - cursor > capacity)          -> overrun, cursor = head - capacity
+ *   copy slots [cursor, head);
+ *   read barrier; head2 = hdr->head;
+ *   slots below head2 + 1 - capacity may have been rewritten during the
+ *   copy and must be discarded.
+ *
+ * From version 2 'latest' holds the newest sample the driver generated,
+ * whether or not it was queued, for consumers that only want the current
+ * temperature. It is guarded like a seqcount; 'latest_seq' is odd while
+ * the slot is being rewritten and 0 until the first sample:
+ *
+ *   do {
+ *           seq = load_acquire(&hdr->latest_seq);
+ *           copy hdr->latest;
+ *           read barrier;
+ *   } while ((seq & 1) || hdr->latest_seq != seq);
+ */
+struct simtemp_ring_header {
+	__u32 version;
+	__u32 capacity; /* number of slots, power of two */
+	__u32 data_offset; /* byte offset of slot 0 from start of mapping */
+	__u32 sample_size; /* sizeof(struct simtemp_sample) */
+	__u32 head; /* next index the driver will write */
+	__u32 tail; /* oldest index still held */
+	__u32 latest_seq;
+	__u32 reserved;
+	struct simtemp_sample latest;
+};
+
+#define SIMTEMP_RING_VERSION 2
+
+/*
+ * 'sampling_us', when non-zero, overrides 'sampling_ms' on SET_CONFIG.
+ * GET_CONFIG reports both; 'sampling_ms' is rounded down and reads 0 for
+ * periods below one millisecond.
+ *
+ * With SIMTEMP_CONFIG_APPLY in 'flags', SET_CONFIG is one transition:
+ * sampling stops, the new values are published, FLUSH drops every queued
+ * sample (all readers, and the rolling window), and sampling restarts if
+ * it was running or ENABLE asks for it, with the timer phase starting
+ * afresh. No sample of the old configuration can follow one of the new.
+ * Without APPLY, 'flags' must be 0; GET_CONFIG always reports 0.
+ *
+ * 'sampling_us' was appended to the original layout, which is still
+ * accepted on its own ioctl numbers: SIMTEMP_IOC_{GET,SET}_CONFIG_V1 carry
+ * only the fields up to 'flags', so SET takes the period from
+ * 'sampling_ms' and GET reports it rounded down to milliseconds.
+ */
 struct simtemp_config {
 	__u32 sampling_ms;
 	__s32 threshold_mC;
 	__u32 mode;
-	__u32 flags; /* Reserved for future use */
+	__u32 flags; /* SIMTEMP_CONFIG_* */
+	__u32 sampling_us;
 };
 
+#define SIMTEMP_CONFIG_APPLY (1U << 0)
+#define SIMTEMP_CONFIG_FLUSH (1U << 1) /* needs APPLY */
+#define SIMTEMP_CONFIG_ENABLE (1U << 2) /* needs APPLY */
+#define SIMTEMP_CONFIG_FLAGS \
+	(SIMTEMP_CONFIG_APPLY | SIMTEMP_CONFIG_FLUSH | SIMTEMP_CONFIG_ENABLE)
+
+/*
+ * 'dropped' was appended to the original layout, which is still accepted
+ * on its own ioctl number: SIMTEMP_IOC_GET_STATS_V1 fills only the
+ * fields up to 'buffer_usage'.
+ */
 struct simtemp_ioctl_stats {
 	__u64 updates;
 	__u64 alerts;
@@ -27,21 +109,150 @@ struct simtemp_ioctl_stats {
 	__u64 poll_calls;
 	__s32 last_error;
 	__u32 buffer_usage;
+	__u64 dropped; /* samples discarded on overflow */
+};
+
+/*
+ * SIMTEMP_IOC_SET_READ_FILTER flags. EVENTS_ONLY hands out, and wakes the
+ * reader for, threshold-crossing samples only; everything in between is
+ * skipped without counting as an overrun.
+ */
+#define SIMTEMP_READ_EVENTS_ONLY (1 << 0)
+
+/* Per-open counters, see SIMTEMP_IOC_GET_READER_STATS */
+struct simtemp_reader_stats {
+	__u64 overruns; /* samples this reader lost to being lapped */
+	__u32 backlog; /* samples queued for this reader */
+	__u32 reserved;
+};
+
+/*
+ * Per-open wakeup condition, similar to SO_RCVLOWAT: blocking read() and
+ * poll() only report data once 'samples' are queued or the oldest queued
+ * sample is 'timeout_ms' old. 'samples' of 0 or 1 wakes on every sample,
+ * 'timeout_ms' of 0 disables the latency limit.
+ */
+struct simtemp_watermark {
+	__u32 samples;
+	__u32 timeout_ms;
+};
+
+/*
+ * Pending threshold alerts, see SIMTEMP_IOC_GET_ALERT. poll() reports
+ * EPOLLPRI on a file from the first crossing after its last GET_ALERT
+ * until the next one, independently of the data stream.
+ */
+struct simtemp_alert {
+	__u32 count; /* crossings since the previous GET_ALERT on this file */
+	__u32 seq; /* crossings since the device was probed, wraps */
+	__u32 above; /* 1 while the temperature is above the threshold */
+	__u32 reserved;
+};
+
+/*
+ * SIMTEMP_IOC_SET_FORMAT: how read() encodes samples for this file.
+ *
+ * COMPACT is a stream of 4-byte records, each one sample relative to the
+ * one before it, with a 20-byte sync frame carrying a full sample wherever
+ * the deltas do not fit, after a gap (OVERRUN), every so often, and at the
+ * start of every read() so each read decodes on its own. The first 16 bits
+ * of a frame tell the two apart:
+ *
+ *   if (frame.dtemp_mC == SIMTEMP_COMPACT_SYNC)        -> sync frame:
+ *           ts = sync.timestamp_ns; temp = sync.temp_mC;
+ *           period = sync.period_ns; flags = sync.flags;
+ *   else                                                -> record:
+ *           ts += period + ((__s16)rec.info >> SIMTEMP_COMPACT_SHIFT) * 1000;
+ *           temp += rec.dtemp_mC;
+ *           flags = rec.info & SIMTEMP_COMPACT_FLAGS;
+ *
+ * Record timestamps are rebuilt to within half a microsecond; temperatures
+ * and flags are exact. read() only returns whole frames and needs room for
+ * at least a sync frame.
+ */
+#define SIMTEMP_FORMAT_SAMPLE 0 /* struct simtemp_sample, the default */
+#define SIMTEMP_FORMAT_COMPACT 1
+
+#define SIMTEMP_COMPACT_SYNC (-0x7fff - 1) /* dtemp_mC of a sync frame */
+#define SIMTEMP_COMPACT_FLAGS 0x7 /* record flags, SIMTEMP_FLAG_* bits 0-2 */
+#define SIMTEMP_COMPACT_SHIFT 3 /* microseconds off the period, signed */
+
+struct simtemp_compact_record {
+	__s16 dtemp_mC; /* change from the previous sample */
+	__u16 info;
+} __attribute__((packed));
+
+struct simtemp_compact_sync {
+	__s16 marker; /* SIMTEMP_COMPACT_SYNC */
+	__u16 flags;
+	__u32 period_ns; /* expected spacing of the records that follow */
+	__u64 timestamp_ns;
+	__s32 temp_mC;
+} __attribute__((packed));
+
+/*
+ * Aggregates over the last 'window' raw samples, see the stats_window
+ * sysfs attribute. 'count' is below 'window' until the window has filled
+ * and 0 while it is disabled. mean and stddev are derived from the sums
+ * for convenience.
+ */
+struct simtemp_window_stats {
+	__u32 window; /* configured size in samples, 0 = disabled */
+	__u32 count;
+	__s32 min_mC;
+	__s32 max_mC;
+	__s64 sum_mC;
+	__u64 sum_sq; /* sum of temp_mC squared */
+	__s32 mean_mC;
+	__u32 stddev_mC;
 };
 
-#define SIMTEMP_IOC_MAXNR 7
+#define SIMTEMP_IOC_MAXNR 17
 
 #define SIMTEMP_MODE_NORMAL_IOCTL 0
 #define SIMTEMP_MODE_NOISY_IOCTL 1
 #define SIMTEMP_MODE_RAMP_IOCTL 2
+#define SIMTEMP_MODE_REPLAY_IOCTL 3 /* needs a trace written to the device */
 
 #define SIMTEMP_IOC_GET_CONFIG _IOR(SIMTEMP_IOC_MAGIC, 1, struct simtemp_config)
 #define SIMTEMP_IOC_SET_CONFIG _IOW(SIMTEMP_IOC_MAGIC, 2, struct simtemp_config)
+/* The original layout, for binaries built before 'sampling_us' */
+#define SIMTEMP_CONFIG_V1_SIZE 16
+#define SIMTEMP_IOC_GET_CONFIG_V1 \
+	_IOC(_IOC_READ, SIMTEMP_IOC_MAGIC, 1, SIMTEMP_CONFIG_V1_SIZE)
+#define SIMTEMP_IOC_SET_CONFIG_V1 \
+	_IOC(_IOC_WRITE, SIMTEMP_IOC_MAGIC, 2, SIMTEMP_CONFIG_V1_SIZE)
 #define SIMTEMP_IOC_GET_STATS \
 	_IOR(SIMTEMP_IOC_MAGIC, 3, struct simtemp_ioctl_stats)
+/* The original layout, for binaries built before 'dropped' */
+#define SIMTEMP_IOCTL_STATS_V1_SIZE 40
+#define SIMTEMP_IOC_GET_STATS_V1 \
+	_IOC(_IOC_READ, SIMTEMP_IOC_MAGIC, 3, SIMTEMP_IOCTL_STATS_V1_SIZE)
 #define SIMTEMP_IOC_RESET_STATS _IO(SIMTEMP_IOC_MAGIC, 4)
 #define SIMTEMP_IOC_ENABLE _IO(SIMTEMP_IOC_MAGIC, 5)
 #define SIMTEMP_IOC_DISABLE _IO(SIMTEMP_IOC_MAGIC, 6)
+/* Drop every queued sample, for all readers */
 #define SIMTEMP_IOC_FLUSH_BUFFER _IO(SIMTEMP_IOC_MAGIC, 7)
+#define SIMTEMP_IOC_GET_READER_STATS \
+	_IOR(SIMTEMP_IOC_MAGIC, 8, struct simtemp_reader_stats)
+#define SIMTEMP_IOC_SET_WATERMARK \
+	_IOW(SIMTEMP_IOC_MAGIC, 9, struct simtemp_watermark)
+/* Resize the sample ring (power of two, device disabled, not mapped) */
+#define SIMTEMP_IOC_SET_BUFFER_SIZE _IOW(SIMTEMP_IOC_MAGIC, 10, __u32)
+/* Per-open delivery filter, a mask of SIMTEMP_READ_* flags */
+#define SIMTEMP_IOC_SET_READ_FILTER _IOW(SIMTEMP_IOC_MAGIC, 11, __u32)
+/* Newest sample without consuming anything, -ENODATA before the first */
+#define SIMTEMP_IOC_GET_LATEST \
+	_IOR(SIMTEMP_IOC_MAGIC, 12, struct simtemp_sample)
+/* eventfd signalled on every threshold crossing, -1 to unregister */
+#define SIMTEMP_IOC_SET_ALERT_EVENTFD _IOW(SIMTEMP_IOC_MAGIC, 13, __s32)
+/* Fetch and acknowledge this file's pending alerts */
+#define SIMTEMP_IOC_GET_ALERT _IOR(SIMTEMP_IOC_MAGIC, 14, struct simtemp_alert)
+/* Per-open read() encoding, one of SIMTEMP_FORMAT_* */
+#define SIMTEMP_IOC_SET_FORMAT _IOW(SIMTEMP_IOC_MAGIC, 15, __u32)
+#define SIMTEMP_IOC_GET_WINDOW_STATS \
+	_IOR(SIMTEMP_IOC_MAGIC, 16, struct simtemp_window_stats)
+/* Drop only this file's backlog, other readers are unaffected */
+#define SIMTEMP_IOC_FLUSH_READER _IO(SIMTEMP_IOC_MAGIC, 17)
 
 #endif /* _NXP_SIMTEMP_IOCTL_H_ */
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* NXP Simulated Temperature Sensor Driver - tracepoints */
+
+/* Copyright (c) 2025 Armando Mares */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simtemp
+
+#if !defined(_NXP_SIMTEMP_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _NXP_SIMTEMP_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+#include "nxp_simtemp_ioctl.h"
+
+#define simtemp_show_flags(flags)                                     \
+	__print_flags(flags, "|",                                     \
+		      { SIMTEMP_FLAG_NEW_SAMPLE, "NEW" },             \
+		      { SIMTEMP_FLAG_THRESHOLD_CROSSED, "CROSSED" },  \
+		      { SIMTEMP_FLAG_OVERRUN, "OVERRUN" })
+
+/* The sampling timer fired; 'jitter_ns' is how late against its expiry */
+TRACE_EVENT(simtemp_timer_expire,
+
+	TP_PROTO(int id, s64 expires_ns, s64 now_ns),
+
+	TP_ARGS(id, expires_ns, now_ns),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(s64, expires_ns)
+		__field(s64, jitter_ns)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->expires_ns = expires_ns;
+		__entry->jitter_ns = now_ns - expires_ns;
+	),
+
+	TP_printk("simtemp%d expires=%lld jitter_ns=%lld", __entry->id,
+		  __entry->expires_ns, __entry->jitter_ns)
+);
+
+/* One sample went into the ring at index 'seq' */
+TRACE_EVENT(simtemp_sample_enqueue,
+
+	TP_PROTO(int id, u32 seq, const struct simtemp_sample *sample),
+
+	TP_ARGS(id, seq, sample),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u32, seq)
+		__field(u64, timestamp_ns)
+		__field(s32, temp_mC)
+		__field(u32, flags)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->seq = seq;
+		__entry->timestamp_ns = sample->timestamp_ns;
+		__entry->temp_mC = sample->temp_mC;
+		__entry->flags = sample->flags;
+	),
+
+	TP_printk("simtemp%d seq=%u ts=%llu temp_mC=%d flags=%s",
+		  __entry->id, __entry->seq, __entry->timestamp_ns,
+		  __entry->temp_mC, simtemp_show_flags(__entry->flags))
+);
+
+/* The producer woke 'woken' sleeping readers with the head at 'head' */
+TRACE_EVENT(simtemp_wakeup,
+
+	TP_PROTO(int id, u32 head, u32 woken),
+
+	TP_ARGS(id, head, woken),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u32, head)
+		__field(u32, woken)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->head = head;
+		__entry->woken = woken;
+	),
+
+	TP_printk("simtemp%d head=%u woken=%u", __entry->id, __entry->head,
+		  __entry->woken)
+);
+
+/*
+ * One read() pass handed out 'count' samples starting at ring index
+ * 'seq'; 'latency_ns' is the age of the oldest of them.
+ */
+TRACE_EVENT(simtemp_read_dequeue,
+
+	TP_PROTO(int id, u32 seq, u32 count, u32 lost, u64 latency_ns),
+
+	TP_ARGS(id, seq, count, lost, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u32, seq)
+		__field(u32, count)
+		__field(u32, lost)
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->seq = seq;
+		__entry->count = count;
+		__entry->lost = lost;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("simtemp%d seq=%u count=%u lost=%u latency_ns=%llu",
+		  __entry->id, __entry->seq, __entry->count, __entry->lost,
+		  __entry->latency_ns)
+);
+
+#endif /* _NXP_SIMTEMP_TRACE_H_ */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nxp_simtemp_trace
+#include <trace/define_trace.h>
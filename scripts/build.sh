@@ -150,6 +150,19 @@ build_kernel_module() {
     return 0
 }
 
+# Build the native benchmark - optional, a failure here only warns
+build_benchmark() {
+    log_info "Building benchmark"
+
+    if make -C "$PROJECT_ROOT/user/bench"; then
+        log_success "Benchmark built at $PROJECT_ROOT/user/bench/simtemp_bench"
+    else
+        log_warning "Benchmark build failed"
+    fi
+
+    return 0
+}
+
 # Set up user applications - prepare the CLI tool for execution
 setup_user_apps() {
     log_info "Setting up user applications"
@@ -280,6 +293,7 @@ main() {
         log_info "Cleaning build artifacts"
         cd "$PROJECT_ROOT/kernel"
         make clean || true
+        make -C "$PROJECT_ROOT/user/bench" clean || true
         log_success "Clean completed"
         exit 0
     fi
@@ -291,6 +305,7 @@ main() {
 
     # Build
     build_kernel_module || exit 1
+    build_benchmark
     setup_user_apps || exit 1
     validate_build || exit 1
 
@@ -9,6 +9,19 @@
 #   sudo ./scripts/regression_test.sh           # Run all tests
 #   sudo ./scripts/regression_test.sh --quick   # Run quick smoke tests only
 #   sudo ./scripts/regression_test.sh --verbose # Verbose output
+#   sudo ./scripts/regression_test.sh --perf    # Performance regression stage
+#
+# The --perf stage runs user/bench/simtemp_bench for every combination of
+# PERF_SAMPLING_US, PERF_BUFFER_SIZES and PERF_STRATEGIES, writes one CSV
+# row per run and fails when throughput drops, or timer jitter or lost
+# samples grow, by more than PERF_TOLERANCE percent against
+# scripts/perf_baseline.csv. Jitter and losses also get an absolute
+# allowance (PERF_JITTER_ALLOWANCE_US, PERF_LOST_ALLOWANCE), so a zero
+# baseline does not fail on a single lost sample. A configuration with no
+# baseline row is held to an a-priori floor instead: the producer's rate
+# (1e6 / sampling_us per reader) less PERF_TOLERANCE, and no lost samples.
+# Regenerate the baseline on the reference machine with --perf
+# --update-baseline.
 #
 # Exit codes:
 #   0: All tests passed
@@ -34,6 +47,8 @@ TESTS_SKIPPED=0
 # Configuration
 VERBOSE=false
 QUICK_MODE=false
+PERF_MODE=false
+UPDATE_BASELINE=false
 
 # Get script directory
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
@@ -42,8 +57,21 @@ PROJECT_ROOT="$(dirname "$SCRIPT_DIR")"
 # Paths
 KERNEL_MODULE="$PROJECT_ROOT/kernel/nxp_simtemp.ko"
 CLI_APP="$PROJECT_ROOT/user/cli/main.py"
-DEVICE_PATH="/dev/simtemp"
-SYSFS_PATH="/sys/class/misc/simtemp"
+DEVICE_PATH="/dev/simtemp0"
+SYSFS_PATH="/sys/class/misc/simtemp0"
+DEBUGFS_PATH="/sys/kernel/debug/simtemp/simtemp0"
+BENCH_APP="$PROJECT_ROOT/user/bench/simtemp_bench"
+PERF_BASELINE="$SCRIPT_DIR/perf_baseline.csv"
+PERF_OUTPUT="$PROJECT_ROOT/perf_results.csv"
+
+# Performance stage matrix, overridable from the environment
+PERF_SAMPLING_US="${PERF_SAMPLING_US:-1000 100 20}"
+PERF_BUFFER_SIZES="${PERF_BUFFER_SIZES:-256 4096}"
+PERF_STRATEGIES="${PERF_STRATEGIES:-batch poll epoll mmap multi}"
+PERF_SECONDS="${PERF_SECONDS:-3}"
+PERF_TOLERANCE="${PERF_TOLERANCE:-20}" # percent
+PERF_JITTER_ALLOWANCE_US="${PERF_JITTER_ALLOWANCE_US:-50}"
+PERF_LOST_ALLOWANCE="${PERF_LOST_ALLOWANCE:-16}" # samples per run
 
 # Parse arguments
 while [[ $# -gt 0 ]]; do
@@ -56,12 +84,29 @@ while [[ $# -gt 0 ]]; do
 		VERBOSE=true
 		shift
 		;;
+	--perf)
+		PERF_MODE=true
+		shift
+		;;
+	--update-baseline)
+		UPDATE_BASELINE=true
+		shift
+		;;
+	--perf-output)
+		PERF_OUTPUT="$2"
+		shift 2
+		;;
 	--help | -h)
 		echo "Usage: $0 [OPTIONS]"
 		echo ""
 		echo "Options:"
 		echo "  --quick       Run quick smoke tests only"
 		echo "  --verbose     Enable verbose output"
+		echo "  --perf        Run the performance regression stage"
+		echo "  --update-baseline"
+		echo "                With --perf, store the results as the new baseline"
+		echo "  --perf-output FILE"
+		echo "                Where --perf writes its CSV (default: perf_results.csv)"
 		echo "  --help        Show this help message"
 		exit 0
 		;;
@@ -242,6 +287,56 @@ test_basic_monitoring() {
 	[[ $exit_code -eq 124 || $exit_code -eq 0 ]]
 }
 
+# Test: Rolling window min/max match the samples the driver handed out.
+# The reader is open before sampling starts and the device is stopped
+# before the comparison, so the window's last samples are all queued.
+test_window_extremes() {
+	local window=16
+
+	echo "0" >"$SYSFS_PATH/enabled" &&
+		echo "10" >"$SYSFS_PATH/sampling_ms" &&
+		echo "$window" >"$SYSFS_PATH/stats_window" || return 1
+
+	python3 - "$CLI_APP" "$DEVICE_PATH" "$SYSFS_PATH" "$window" <<'EOF'
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(sys.argv[1]))
+import main as cli  # noqa: E402  pylint: disable=wrong-import-position
+
+device, sysfs, window = sys.argv[2], sys.argv[3], int(sys.argv[4])
+dev = cli.SimtempDevice(device)
+if not dev.open():
+    sys.exit(1)
+
+
+def set_enabled(value):
+    with open(os.path.join(sysfs, "enabled"), "w", encoding="utf-8") as f:
+        f.write(value)
+
+
+set_enabled("1")
+time.sleep(1)
+set_enabled("0")
+
+temps = []
+while True:
+    samples = dev.read_samples(256)
+    if samples is None or not len(samples):
+        break
+    # numpy records and plain tuples both index as (ts, temp_mC, flags)
+    temps.extend(int(s[1]) for s in samples)
+
+ws = dev.get_window_stats()
+dev.close()
+
+last = temps[-window:]
+sys.exit(0 if ws and len(last) == window and ws["count"] == window and
+         ws["min_mC"] == min(last) and ws["max_mC"] == max(last) else 1)
+EOF
+}
+
 # Test: Sampling rate configuration
 test_sampling_configuration() {
 	echo "200" >"$SYSFS_PATH/sampling_ms" &&
@@ -286,6 +381,163 @@ test_no_unload_warnings() {
 	! dmesg | tail -10 | grep -i "warning\|error\|oops"
 }
 
+# p99 timer jitter in microseconds from the debugfs histogram, empty if
+# debugfs is unavailable. Lines are "low high count" log2 buckets; the
+# bucket's upper bound is reported so the figure never understates.
+perf_jitter_p99() {
+	local hist="$DEBUGFS_PATH/timer_jitter_ns"
+
+	[[ -r "$hist" ]] || return 0
+
+	awk '{ low[NR] = $1; high[NR] = $2; count[NR] = $3; total += $3 }
+	END {
+		if (!total)
+			exit
+		for (i = 1; i <= NR; i++) {
+			seen += count[i]
+			if (seen >= total * 0.99) {
+				v = high[i] == "inf" ? low[i] : high[i] + 1
+				printf "%.1f", v / 1000
+				exit
+			}
+		}
+	}' "$hist"
+}
+
+# Run one benchmark and append its result row to PERF_OUTPUT
+perf_run() {
+	local sampling_us="$1" buffer_size="$2" strategy="$3"
+	local out line jitter
+
+	echo "0" >"$SYSFS_PATH/enabled"
+	echo "$buffer_size" >"$SYSFS_PATH/buffer_size" || return 1
+	echo "$sampling_us" >"$SYSFS_PATH/sampling_us" || return 1
+
+	if [[ -d "$DEBUGFS_PATH" ]]; then
+		echo 1 >"$DEBUGFS_PATH/hist_reset"
+		echo 1 >"$DEBUGFS_PATH/hist_enable"
+	fi
+
+	# The bench enables the device itself; skip its CSV header
+	out=$("$BENCH_APP" --device "$DEVICE_PATH" --strategy "$strategy" \
+		--seconds "$PERF_SECONDS" --csv) || return 1
+	line=$(echo "$out" | tail -n 1)
+
+	jitter=$(perf_jitter_p99)
+	[[ -d "$DEBUGFS_PATH" ]] && echo 0 >"$DEBUGFS_PATH/hist_enable"
+
+	# strategy,readers,samples,samples_per_s,syscalls_per_sample,p50_us,
+	# p90_us,p99_us,p999_us,max_us,lost,dropped,drop_pct
+	echo "$line" | awk -F, -v s="$sampling_us" -v b="$buffer_size" \
+		-v j="$jitter" \
+		'{ printf "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+			s, b, $1, $2, $4, $5, $8, j, $11, $12 }' >>"$PERF_OUTPUT"
+}
+
+# Compare one result row against its baseline row, with an absolute
+# allowance of 'lost_allow' lost samples; prints what regressed
+perf_compare() {
+	local row="$1" base="$2" lost_allow="$3"
+
+	awk -F, -v tol="$PERF_TOLERANCE" -v r="$row" -v b="$base" \
+		-v jitter_allow="$PERF_JITTER_ALLOWANCE_US" \
+		-v lost_allow="$lost_allow" 'BEGIN {
+		split(r, R, ","); split(b, B, ",")
+		slack = tol / 100
+		if (R[5] < B[5] * (1 - slack))
+			printf "throughput %s/s < %s/s; ", R[5], B[5]
+		# Relative slack plus an absolute floor for small baselines
+		jitter_max = B[8] * (1 + slack) + jitter_allow
+		if (R[8] != "" && B[8] != "" && R[8] > jitter_max)
+			printf "jitter p99 %sus > %.1fus; ", R[8], jitter_max
+		lost_max = (B[9] + B[10]) * (1 + slack) + lost_allow
+		if (R[9] + R[10] > lost_max)
+			printf "lost %d > %s; ", R[9] + R[10], lost_max
+	}'
+}
+
+# Baseline row for a configuration that has not been measured: what
+# the producer generates for every reader, no jitter figure, no losses
+perf_floor() {
+	echo "$1" | awk -F, '{
+		printf "%s,%s,%s,%s,%.0f,,,,0,0\n",
+			$1, $2, $3, $4, $4 * 1000000 / $1 }'
+}
+
+# Performance regression stage
+run_perf_tests() {
+	local sampling_us buffer_size strategy key row base regress what allow
+
+	if [[ ! -x "$BENCH_APP" ]]; then
+		log_info "Building benchmark..."
+		make -C "$PROJECT_ROOT/user/bench" >/dev/null || {
+			log_error "Benchmark build failed"
+			TESTS_FAILED=$((TESTS_FAILED + 1))
+			return 1
+		}
+	fi
+
+	echo "sampling_us,buffer_size,strategy,readers,samples_per_s,syscalls_per_sample,p99_us,jitter_p99_us,lost,dropped" >"$PERF_OUTPUT"
+
+	for sampling_us in $PERF_SAMPLING_US; do
+		for buffer_size in $PERF_BUFFER_SIZES; do
+			for strategy in $PERF_STRATEGIES; do
+				log_test_start "perf $sampling_us us / $buffer_size / $strategy"
+				if ! perf_run "$sampling_us" "$buffer_size" "$strategy"; then
+					log_error "P1: $strategy at ${sampling_us} us, buffer $buffer_size did not run"
+					TESTS_FAILED=$((TESTS_FAILED + 1))
+				fi
+			done
+		done
+	done
+	echo "0" >"$SYSFS_PATH/enabled"
+
+	log_info "Results written to $PERF_OUTPUT"
+
+	if $UPDATE_BASELINE; then
+		{
+			echo "# Performance baseline for scripts/regression_test.sh --perf"
+			echo "# Measured on $(uname -n), kernel $(uname -r), $(date -u +%Y-%m-%d)"
+			echo "# CPU: $(awk -F': ' '/^model name/ { print $2; exit }' /proc/cpuinfo), $(nproc) CPUs"
+			echo "# PERF_SECONDS=$PERF_SECONDS PERF_SAMPLING_US=\"$PERF_SAMPLING_US\""
+			echo "# PERF_BUFFER_SIZES=\"$PERF_BUFFER_SIZES\" PERF_STRATEGIES=\"$PERF_STRATEGIES\""
+			echo "# Command: sudo ./scripts/regression_test.sh --perf --update-baseline"
+			cat "$PERF_OUTPUT"
+		} >"$PERF_BASELINE"
+		log_success "Baseline updated: $PERF_BASELINE"
+		return 0
+	fi
+
+	[[ -f "$PERF_BASELINE" ]] ||
+		log_warning "No baseline at $PERF_BASELINE, checking the a-priori floor"
+
+	while IFS= read -r row; do
+		key=$(echo "$row" | cut -d, -f1-3)
+		base=""
+		[[ -f "$PERF_BASELINE" ]] &&
+			base=$(grep -v '^#' "$PERF_BASELINE" | grep "^$key," | head -n 1)
+
+		# Unmeasured configurations must still meet the producer's rate
+		if [[ -n "$base" ]]; then
+			what="baseline"
+			allow="$PERF_LOST_ALLOWANCE"
+		else
+			base=$(perf_floor "$row")
+			what="a-priori floor"
+			allow=0
+		fi
+
+		regress=$(perf_compare "$row" "$base" "$allow")
+		if [[ -z "$regress" ]]; then
+			log_success "P2: $key within ${PERF_TOLERANCE}% of $what"
+			TESTS_PASSED=$((TESTS_PASSED + 1))
+		else
+			log_error "P2: $key regressed against $what: $regress"
+			TESTS_FAILED=$((TESTS_FAILED + 1))
+		fi
+	done < <(tail -n +2 "$PERF_OUTPUT")
+}
+
 # Print test summary
 print_summary() {
 	local total=$((TESTS_PASSED + TESTS_FAILED + TESTS_SKIPPED))
@@ -339,7 +591,11 @@ main() {
 	run_test "T1.1: Module listed in lsmod" test_module_listed
 	run_test "T1.1: No kernel errors" test_no_kernel_errors
 
-	if $QUICK_MODE; then
+	if $PERF_MODE; then
+		echo ""
+		log_info "Performance Regression Tests"
+		run_perf_tests
+	elif $QUICK_MODE; then
 		log_info "Quick mode: Skipping extended tests"
 		TESTS_SKIPPED=10
 	else
@@ -358,6 +614,7 @@ main() {
 		log_info "Phase 3: Functional Tests"
 		run_test "T3: Threshold alert test" test_threshold_alert
 		run_test "T2: Basic monitoring" test_basic_monitoring
+		run_test "T3: Window min/max match samples" test_window_extremes
 
 		# Phase 4: Error Handling
 		echo ""
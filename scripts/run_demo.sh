@@ -48,7 +48,7 @@ PROJECT_ROOT="$(dirname "$SCRIPT_DIR")"
 # Paths
 KERNEL_MODULE="$PROJECT_ROOT/kernel/nxp_simtemp.ko"
 CLI_APP="$PROJECT_ROOT/user/cli/main.py"
-DEVICE_PATH="/dev/simtemp"
+DEVICE_PATH="/dev/simtemp0"
 
 # Demo configuration
 DEMO_DURATION=10
@@ -68,7 +68,7 @@ cleanup() {
     fi
 
     # Disable device
-    echo "0" > /sys/class/misc/simtemp/enabled 2>/dev/null || true
+    echo "0" > /sys/class/misc/simtemp0/enabled 2>/dev/null || true
 
     # Unload module
     if lsmod | grep -q nxp_simtemp 2>/dev/null; then
@@ -144,7 +144,7 @@ load_module() {
         fi
 
         # Check sysfs attributes
-        local sysfs_base="/sys/class/misc/simtemp"
+        local sysfs_base="/sys/class/misc/simtemp0"
         if [[ -d "$sysfs_base" ]]; then
             log_success "Sysfs attributes available at $sysfs_base"
 
@@ -217,7 +217,7 @@ test_basic_functionality() {
 
     # Test sysfs access
     log_info "Testing sysfs access"
-    local sysfs_base="/sys/class/misc/simtemp"
+    local sysfs_base="/sys/class/misc/simtemp0"
     local value
     for attr in sampling_ms threshold_mC mode enabled stats; do
         if [[ -r "$sysfs_base/$attr" ]]; then
@@ -384,7 +384,7 @@ show_performance_metrics() {
     # Show updated statistics
     echo
     echo "  Current Statistics:"
-    sed 's/^/    /' < /sys/class/misc/simtemp/stats 2>/dev/null
+    sed 's/^/    /' < /sys/class/misc/simtemp0/stats 2>/dev/null
 
     # Restore normal sampling
     "$CLI_APP" --sampling 100 > /dev/null 2>&1
@@ -436,11 +436,11 @@ test_error_handling() {
 
     # Test 1: Invalid sampling period
     log_info "Test 1: Invalid sampling period (too high)"
-    if echo "999999" > /sys/class/misc/simtemp/sampling_ms 2>&1 | grep -q "Invalid\|cannot"; then
+    if echo "999999" > /sys/class/misc/simtemp0/sampling_ms 2>&1 | grep -q "Invalid\|cannot"; then
         log_success "Invalid sampling period rejected correctly"
     else
         local result
-        result=$(echo "999999" > /sys/class/misc/simtemp/sampling_ms 2>&1 || echo "rejected")
+        result=$(echo "999999" > /sys/class/misc/simtemp0/sampling_ms 2>&1 || echo "rejected")
         if [[ "$result" == *"rejected"* ]] || [[ "$result" == *"Invalid"* ]]; then
             log_success "Invalid sampling period rejected correctly"
         else
@@ -450,11 +450,11 @@ test_error_handling() {
 
     # Test 2: Invalid mode
     log_info "Test 2: Invalid mode string"
-    if echo "invalid_mode" > /sys/class/misc/simtemp/mode 2>&1 | grep -q "Invalid\|cannot"; then
+    if echo "invalid_mode" > /sys/class/misc/simtemp0/mode 2>&1 | grep -q "Invalid\|cannot"; then
         log_success "Invalid mode rejected correctly"
     else
         local result
-        result=$(echo "invalid_mode" > /sys/class/misc/simtemp/mode 2>&1 || echo "rejected")
+        result=$(echo "invalid_mode" > /sys/class/misc/simtemp0/mode 2>&1 || echo "rejected")
         if [[ "$result" == *"rejected"* ]] || [[ "$result" == *"Invalid"* ]]; then
             log_success "Invalid mode rejected correctly"
         else
@@ -575,7 +575,7 @@ print_summary() {
     echo "  Kernel module: $KERNEL_MODULE"
     echo "  CLI app:       $CLI_APP"
     echo "  Device:        $DEVICE_PATH"
-    echo "  Sysfs:         /sys/class/misc/simtemp/"
+    echo "  Sysfs:         /sys/class/misc/simtemp0/"
     echo
 }
 
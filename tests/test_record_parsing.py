@@ -7,10 +7,16 @@ Author: Armando Mares
 License: GPL-2.0
 """
 
+import os
+import sys
 import unittest
 import struct
 import time
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'user', 'cli'))
+import main as cli  # noqa: E402  pylint: disable=wrong-import-position
+
 
 # Constants matching kernel driver definitions
 SIMTEMP_SAMPLE_SIZE = 16
@@ -183,6 +189,189 @@ class TestBufferHandling(unittest.TestCase):
             self.assertEqual(temp, 25000 + i*100)
 
 
+class TestBulkDecoding(unittest.TestCase):
+    """Test the CLI's bulk decode used by read_samples()"""
+
+    def _buffer(self, count):
+        samples = [
+            SimtempSample(1000000 + i * 100000, 25000 - i * 700,
+                          SIMTEMP_FLAG_NEW_SAMPLE |
+                          (SIMTEMP_FLAG_THRESHOLD_CROSSED if i % 3 == 0
+                           else 0))
+            for i in range(count)
+        ]
+        return samples, bytearray(b''.join(s.pack() for s in samples))
+
+    def _check(self, decoded, samples):
+        self.assertEqual(len(decoded), len(samples))
+        for rec, sample in zip(decoded, samples):
+            self.assertEqual(int(rec[0]), sample.timestamp_ns)
+            self.assertEqual(int(rec[1]), sample.temp_mC)
+            self.assertEqual(int(rec[2]), sample.flags)
+
+    def test_layout_matches_kernel(self):
+        """The CLI's record layout is the packed 16-byte kernel struct"""
+        self.assertEqual(cli.SAMPLE_SIZE, SIMTEMP_SAMPLE_SIZE)
+        self.assertEqual(cli.SAMPLE_SIZE, cli.sizeof(cli.SimtempSample))
+
+    def test_struct_fallback(self):
+        """Without numpy, records decode through struct.iter_unpack()"""
+        samples, buf = self._buffer(7)
+        self._check(cli.decode_samples(buf, use_numpy=False), samples)
+
+    @unittest.skipIf(cli.numpy is None, "numpy not installed")
+    def test_numpy_zero_copy(self):
+        """The numpy result is a view of the read buffer"""
+        samples, buf = self._buffer(7)
+        decoded = cli.decode_samples(buf, use_numpy=True)
+        self._check(decoded, samples)
+
+        struct.pack_into('=i', buf, 8, -1234)
+        self.assertEqual(int(decoded[0]['temp_mC']), -1234)
+
+    def test_partial_record_ignored(self):
+        """A trailing partial record is not decoded"""
+        samples, buf = self._buffer(3)
+        decoded = cli.decode_samples(memoryview(buf)[:-5])
+        self._check(decoded, samples[:2])
+
+    def test_empty_buffer(self):
+        """An empty read decodes to no samples"""
+        self.assertEqual(len(cli.decode_samples(b'')), 0)
+        self.assertEqual(cli.summarize_samples([])[0], 0)
+
+    def test_summary(self):
+        """The per-second summary counts, bounds and flags a batch"""
+        samples, buf = self._buffer(7)
+        for use_numpy in ([False, True] if cli.numpy is not None
+                          else [False]):
+            decoded = cli.decode_samples(buf, use_numpy=use_numpy)
+            count, low, high, total, alerts, overruns = \
+                cli.summarize_samples(decoded)
+            temps = [s.temp_mC for s in samples]
+            self.assertEqual(count, 7)
+            self.assertEqual(low, min(temps))
+            self.assertEqual(high, max(temps))
+            self.assertEqual(total, sum(temps))
+            self.assertEqual(alerts, 3)
+            self.assertEqual(overruns, 0)
+
+
+class TestCompactDecoding(unittest.TestCase):
+    """Test decoding of the SIMTEMP_FORMAT_COMPACT stream"""
+
+    PERIOD_NS = 10000
+
+    def _sync(self, ts, temp, flags=SIMTEMP_FLAG_NEW_SAMPLE):
+        return struct.pack(cli.COMPACT_SYNC_FORMAT, cli.COMPACT_SYNC, flags,
+                           self.PERIOD_NS, ts, temp)
+
+    def _record(self, dtemp, drift_us, flags=SIMTEMP_FLAG_NEW_SAMPLE):
+        info = ((drift_us << cli.COMPACT_SHIFT) & 0xffff) | flags
+        return struct.pack(cli.COMPACT_RECORD_FORMAT, dtemp, info)
+
+    def test_frame_sizes(self):
+        """Records are 4 bytes and sync frames 20, as in the kernel"""
+        self.assertEqual(cli.COMPACT_RECORD_SIZE, 4)
+        self.assertEqual(cli.COMPACT_SYNC_SIZE, 20)
+
+    def test_records_follow_sync(self):
+        """Records add the period, the drift and the temperature delta"""
+        buf = (self._sync(1000000, 25000) +
+               self._record(12, 0) +
+               self._record(-30, 3) +
+               self._record(5, -2, SIMTEMP_FLAG_NEW_SAMPLE |
+                            SIMTEMP_FLAG_THRESHOLD_CROSSED))
+        self.assertEqual(cli.decode_compact(buf), [
+            (1000000, 25000, SIMTEMP_FLAG_NEW_SAMPLE),
+            (1010000, 25012, SIMTEMP_FLAG_NEW_SAMPLE),
+            (1023000, 24982, SIMTEMP_FLAG_NEW_SAMPLE),
+            (1031000, 24987, SIMTEMP_FLAG_NEW_SAMPLE |
+             SIMTEMP_FLAG_THRESHOLD_CROSSED),
+        ])
+
+    def test_resync(self):
+        """A sync frame in the middle restarts from absolute values"""
+        buf = (self._sync(1000000, 25000) + self._record(1, 0) +
+               self._sync(5000000, -40000) + self._record(-1, -4096))
+        decoded = cli.decode_compact(buf)
+        self.assertEqual(decoded[2], (5000000, -40000,
+                                      SIMTEMP_FLAG_NEW_SAMPLE))
+        self.assertEqual(decoded[3], (5000000 + self.PERIOD_NS - 4096000,
+                                      -40001, SIMTEMP_FLAG_NEW_SAMPLE))
+
+    def test_truncated_frame_ignored(self):
+        """A partial trailing frame is not decoded"""
+        buf = self._sync(1000000, 25000) + self._record(1, 0)
+        self.assertEqual(len(cli.decode_compact(buf[:-1])), 1)
+        self.assertEqual(len(cli.decode_compact(buf[:10])), 0)
+
+
+class WindowQueue:
+    """Model of simtemp_window_queue(): a monotonic deque in a ring of
+    roundup_pow_of_two(size) slots indexed by free-running head/tail.
+
+    This is a copy of the kernel algorithm, not the driver itself; keep it
+    in step with kernel/nxp_simtemp.c. The regression script checks the
+    real driver's window against the samples it hands out."""
+
+    def __init__(self, size, is_max):
+        capacity = 1 << (size - 1).bit_length()
+        self.size = size
+        self.mask = capacity - 1
+        self.ring = [None] * capacity
+        self.head = self.tail = 0
+        self.is_max = is_max
+
+    def push(self, seq, mC):
+        if (self.tail != self.head and
+                seq - self.ring[self.head & self.mask][0] >= self.size):
+            self.head += 1
+
+        while self.tail != self.head:
+            last = self.ring[(self.tail - 1) & self.mask][1]
+            if not (last <= mC if self.is_max else last >= mC):
+                break
+            self.tail -= 1
+
+        self.ring[self.tail & self.mask] = (seq, mC)
+        self.tail += 1
+
+    def extreme(self):
+        return self.ring[self.head & self.mask][1]
+
+
+class TestWindowExtremes(unittest.TestCase):
+    """Model test: the window's min/max queues against a brute force"""
+
+    def _check(self, size, temps):
+        min_q, max_q = WindowQueue(size, False), WindowQueue(size, True)
+        for seq, mC in enumerate(temps):
+            min_q.push(seq, mC)
+            max_q.push(seq, mC)
+            window = temps[max(0, seq - size + 1):seq + 1]
+            self.assertEqual(min_q.extreme(), min(window),
+                             f"size={size} seq={seq}")
+            self.assertEqual(max_q.extreme(), max(window),
+                             f"size={size} seq={seq}")
+
+    def test_rising_ramp_power_of_two(self):
+        """A ramp keeps every entry in the min queue, filling it exactly"""
+        for size in (1, 2, 4, 1024):
+            self._check(size, [25000 + 10 * i for i in range(3 * size + 7)])
+
+    def test_falling_ramp_power_of_two(self):
+        """The same for the max queue on a falling ramp"""
+        for size in (4, 1024):
+            self._check(size, [45000 - 10 * i for i in range(3 * size + 7)])
+
+    def test_other_sizes(self):
+        """Windows that leave spare slots in the ring"""
+        temps = [25000 + (i * 7919) % 2000 for i in range(500)]
+        for size in (3, 5, 100):
+            self._check(size, temps)
+
+
 class TestEdgeCases(unittest.TestCase):
     """Test edge cases and error conditions"""
 
@@ -242,6 +431,9 @@ def run_tests():
     suite.addTests(loader.loadTestsFromTestCase(TestRecordParsing))
     suite.addTests(loader.loadTestsFromTestCase(TestEventLogic))
     suite.addTests(loader.loadTestsFromTestCase(TestBufferHandling))
+    suite.addTests(loader.loadTestsFromTestCase(TestBulkDecoding))
+    suite.addTests(loader.loadTestsFromTestCase(TestCompactDecoding))
+    suite.addTests(loader.loadTestsFromTestCase(TestWindowExtremes))
     suite.addTests(loader.loadTestsFromTestCase(TestEdgeCases))
 
     runner = unittest.TextTestRunner(verbosity=2)
@@ -0,0 +1,816 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * NXP Simulated Temperature Sensor - throughput and latency benchmark
+ *
+ * Drives /dev/simtemp<N> with one read strategy at a time and reports
+ * sustained samples/s, syscalls per sample, the age of each sample when
+ * it reaches user space (from its timestamp_ns) and the share of samples
+ * lost to overruns.
+ *
+ * Copyright (c) 2025 Armando Mares
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "nxp_simtemp_ioctl.h"
+
+#define BENCH_DEFAULT_DEVICE "/dev/simtemp0"
+#define BENCH_DEFAULT_SECONDS 5
+#define BENCH_DEFAULT_BATCH 256
+#define BENCH_DEFAULT_MULTI 4
+#define BENCH_MAX_READERS 64
+#define BENCH_POLL_TIMEOUT_MS 100
+#define BENCH_MMAP_IDLE_US 50 /* sleep of an mmap reader with nothing new */
+
+/*
+ * Log-linear latency histogram: values below 16 ns get a bucket each,
+ * every power of two above is split into 16 buckets, so percentiles are
+ * within ~6% of the true value.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1U << LAT_SUB_BITS)
+#define LAT_BUCKETS ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+enum strategy {
+	STRATEGY_SINGLE, /* blocking read() of one sample */
+	STRATEGY_BATCH, /* blocking read() of up to --batch samples */
+	STRATEGY_POLL, /* poll() then non-blocking reads until EAGAIN */
+	STRATEGY_EPOLL, /* same with epoll_wait() */
+	STRATEGY_MMAP, /* walk the shared ring, no read() at all */
+	STRATEGY_MULTI, /* batched read() from --multi readers at once */
+	STRATEGY_MAX
+};
+
+static const char *const strategy_names[] = {
+	[STRATEGY_SINGLE] = "single", [STRATEGY_BATCH] = "batch",
+	[STRATEGY_POLL] = "poll",     [STRATEGY_EPOLL] = "epoll",
+	[STRATEGY_MMAP] = "mmap",     [STRATEGY_MULTI] = "multi",
+};
+
+struct bench_opts {
+	const char *device;
+	unsigned int seconds;
+	unsigned int batch;
+	unsigned int multi;
+	unsigned int watermark;
+	unsigned int sampling_us;
+	bool csv;
+	bool strategies[STRATEGY_MAX];
+};
+
+struct lat_hist {
+	uint64_t count[LAT_BUCKETS];
+	uint64_t max;
+};
+
+/* One reader thread's share of a run */
+struct bench_reader {
+	pthread_t thread;
+	const struct bench_opts *opts;
+	enum strategy strategy;
+	uint64_t deadline_ns;
+	int error;
+	bool started; /* passed the start barrier */
+
+	uint64_t samples;
+	uint64_t syscalls;
+	uint64_t lost;
+	struct lat_hist lat;
+};
+
+static pthread_barrier_t start_barrier;
+
+/* Setup done: wait for the others, the measured interval starts now */
+static void reader_start(struct bench_reader *r)
+{
+	pthread_barrier_wait(&start_barrier);
+	r->started = true;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	/* The driver stamps samples with ktime_get_ns(), CLOCK_MONOTONIC */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int lat_bucket(uint64_t v)
+{
+	unsigned int msb;
+
+	if (v < LAT_SUB)
+		return v;
+
+	msb = 63 - __builtin_clzll(v);
+	return (msb - LAT_SUB_BITS + 1) * LAT_SUB +
+	       ((v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Lowest value that falls into bucket 'i' */
+static uint64_t lat_bucket_floor(unsigned int i)
+{
+	unsigned int msb;
+
+	if (i < LAT_SUB)
+		return i;
+
+	msb = i / LAT_SUB + LAT_SUB_BITS - 1;
+	return (1ULL << msb) | ((uint64_t)(i % LAT_SUB) << (msb - LAT_SUB_BITS));
+}
+
+static void lat_add(struct lat_hist *h, uint64_t v)
+{
+	h->count[lat_bucket(v)]++;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void lat_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		dst->count[i] += src->count[i];
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static uint64_t lat_percentile(const struct lat_hist *h, uint64_t total,
+			       double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (!total)
+		return 0;
+
+	rank = (uint64_t)(total * pct / 100.0);
+	if (rank >= total)
+		rank = total - 1;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->count[i];
+		if (seen > rank)
+			return lat_bucket_floor(i);
+	}
+
+	return h->max;
+}
+
+/* Account samples handed out to user space at 'now' */
+static void account_samples(struct bench_reader *r,
+			    const struct simtemp_sample *s, size_t n,
+			    uint64_t now)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		lat_add(&r->lat, now > s[i].timestamp_ns ?
+					 now - s[i].timestamp_ns : 0);
+	r->samples += n;
+}
+
+/* Throw away what the ring already holds so old samples skew nothing */
+static int drain_backlog(int fd, struct simtemp_sample *buf, size_t max)
+{
+	int flags = fcntl(fd, F_GETFL);
+	ssize_t ret;
+
+	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+		return -errno;
+
+	do
+		ret = read(fd, buf, max * sizeof(*buf));
+	while (ret > 0);
+
+	if (ret < 0 && errno != EAGAIN)
+		return -errno;
+
+	if (fcntl(fd, F_SETFL, flags))
+		return -errno;
+
+	return 0;
+}
+
+static int run_read(struct bench_reader *r, int fd, size_t batch)
+{
+	struct simtemp_sample *buf;
+	ssize_t ret;
+	int err = 0;
+
+	buf = calloc(batch, sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	err = drain_backlog(fd, buf, batch);
+	reader_start(r);
+
+	while (!err && now_ns() < r->deadline_ns) {
+		ret = read(fd, buf, batch * sizeof(*buf));
+		r->syscalls++;
+		if (ret < 0) {
+			if (errno != EINTR)
+				err = -errno;
+			continue;
+		}
+
+		account_samples(r, buf, ret / sizeof(*buf), now_ns());
+	}
+
+	free(buf);
+	return err;
+}
+
+/* Non-blocking reads until the reader is empty */
+static int read_available(struct bench_reader *r, int fd,
+			  struct simtemp_sample *buf, size_t batch)
+{
+	ssize_t ret;
+
+	for (;;) {
+		ret = read(fd, buf, batch * sizeof(*buf));
+		r->syscalls++;
+		if (ret < 0)
+			return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+
+		account_samples(r, buf, ret / sizeof(*buf), now_ns());
+	}
+}
+
+static int run_poll(struct bench_reader *r, int fd, size_t batch)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct simtemp_sample *buf;
+	int ret, err;
+
+	buf = calloc(batch, sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	err = drain_backlog(fd, buf, batch);
+	if (!err && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+		err = -errno;
+	reader_start(r);
+
+	while (!err && now_ns() < r->deadline_ns) {
+		ret = poll(&pfd, 1, BENCH_POLL_TIMEOUT_MS);
+		r->syscalls++;
+		if (ret < 0) {
+			if (errno != EINTR)
+				err = -errno;
+			continue;
+		}
+
+		if (ret && (pfd.revents & POLLIN))
+			err = read_available(r, fd, buf, batch);
+	}
+
+	free(buf);
+	return err;
+}
+
+static int run_epoll(struct bench_reader *r, int fd, size_t batch)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+	struct simtemp_sample *buf;
+	int epfd, ret, err;
+
+	buf = calloc(batch, sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		free(buf);
+		return -errno;
+	}
+
+	err = drain_backlog(fd, buf, batch);
+	if (!err && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+		err = -errno;
+	if (!err && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		err = -errno;
+	reader_start(r);
+
+	while (!err && now_ns() < r->deadline_ns) {
+		ret = epoll_wait(epfd, &ev, 1, BENCH_POLL_TIMEOUT_MS);
+		r->syscalls++;
+		if (ret < 0) {
+			if (errno != EINTR)
+				err = -errno;
+			continue;
+		}
+
+		if (ret && (ev.events & EPOLLIN))
+			err = read_available(r, fd, buf, batch);
+	}
+
+	close(epfd);
+	free(buf);
+	return err;
+}
+
+/* Follows the protocol documented in nxp_simtemp_ioctl.h */
+static int run_mmap(struct bench_reader *r, int fd, size_t batch)
+{
+	const struct timespec idle = { .tv_nsec = BENCH_MMAP_IDLE_US * 1000 };
+	volatile struct simtemp_ring_header *hdr;
+	const struct simtemp_sample *slots;
+	struct simtemp_ring_header probe;
+	struct simtemp_sample *buf;
+	uint32_t cursor, head, valid_from, n, i;
+	size_t len;
+	void *map;
+
+	/* The header page alone tells how big the whole mapping is */
+	map = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+	probe = *(struct simtemp_ring_header *)map;
+	munmap(map, sysconf(_SC_PAGESIZE));
+
+	if (probe.sample_size != sizeof(struct simtemp_sample))
+		return -EPROTO;
+
+	len = probe.data_offset +
+	      (size_t)probe.capacity * sizeof(struct simtemp_sample);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	hdr = map;
+	slots = (const void *)((const char *)map + probe.data_offset);
+
+	buf = calloc(batch, sizeof(*buf));
+	if (!buf) {
+		munmap(map, len);
+		return -ENOMEM;
+	}
+
+	cursor = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	reader_start(r);
+
+	while (now_ns() < r->deadline_ns) {
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (head == cursor) {
+			nanosleep(&idle, NULL);
+			r->syscalls++;
+			continue;
+		}
+
+		if (head - cursor > probe.capacity) {
+			r->lost += head - cursor - probe.capacity;
+			cursor = head - probe.capacity;
+		}
+
+		n = head - cursor;
+		if (n > batch)
+			n = batch;
+		for (i = 0; i < n; i++)
+			buf[i] = slots[(cursor + i) & (probe.capacity - 1)];
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		/* Drop whatever the driver may have recycled meanwhile */
+		head = hdr->head;
+		valid_from = head + 1 - probe.capacity;
+		i = 0;
+		if ((int32_t)(valid_from - cursor) > 0) {
+			i = valid_from - cursor < n ? valid_from - cursor : n;
+			r->lost += i;
+		}
+
+		account_samples(r, buf + i, n - i, now_ns());
+		cursor += n;
+	}
+
+	free(buf);
+	munmap(map, len);
+	return 0;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct bench_reader *r = arg;
+	const struct bench_opts *opts = r->opts;
+	struct simtemp_reader_stats rstats;
+	struct simtemp_watermark wm = { .samples = opts->watermark };
+	size_t batch = r->strategy == STRATEGY_SINGLE ? 1 : opts->batch;
+	int fd;
+
+	fd = open(opts->device, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		r->error = -errno;
+		reader_start(r);
+		return NULL;
+	}
+
+	if (wm.samples > 1 && ioctl(fd, SIMTEMP_IOC_SET_WATERMARK, &wm))
+		fprintf(stderr, "warning: SET_WATERMARK: %s\n", strerror(errno));
+
+	switch (r->strategy) {
+	case STRATEGY_POLL:
+		r->error = run_poll(r, fd, batch);
+		break;
+	case STRATEGY_EPOLL:
+		r->error = run_epoll(r, fd, batch);
+		break;
+	case STRATEGY_MMAP:
+		r->error = run_mmap(r, fd, batch);
+		break;
+	default:
+		r->error = run_read(r, fd, batch);
+		break;
+	}
+
+	/* A setup failure must not leave the others stuck at the barrier */
+	if (!r->started)
+		reader_start(r);
+
+	/* Overruns of read() consumers are counted by the driver */
+	if (r->strategy != STRATEGY_MMAP &&
+	    !ioctl(fd, SIMTEMP_IOC_GET_READER_STATS, &rstats))
+		r->lost += rstats.overruns;
+
+	close(fd);
+	return NULL;
+}
+
+/* Device state from before the run, put back on every way out */
+static struct {
+	int fd; /* -1 until there is something to restore */
+	struct simtemp_config config;
+	bool enabled;
+} saved = { .fd = -1 };
+
+/* The ioctls know no enable state, sysfs does */
+static int read_enabled(const char *device, bool *enabled)
+{
+	char dev[PATH_MAX], path[PATH_MAX + 32];
+	const char *name;
+	FILE *f;
+	int val;
+
+	if (!realpath(device, dev))
+		return -errno;
+
+	name = strrchr(dev, '/');
+	snprintf(path, sizeof(path), "/sys/class/misc/%s/enabled",
+		 name ? name + 1 : dev);
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+
+	if (val < 0)
+		return -EINVAL;
+
+	*enabled = val;
+	return 0;
+}
+
+/* Only system calls, so it is also safe from the signal handler */
+static int restore_device(void)
+{
+	int ret = 0;
+
+	if (saved.fd < 0)
+		return 0;
+
+	if (ioctl(saved.fd, SIMTEMP_IOC_SET_CONFIG, &saved.config))
+		ret = -errno;
+	if (!saved.enabled && ioctl(saved.fd, SIMTEMP_IOC_DISABLE))
+		ret = -errno;
+
+	saved.fd = -1;
+	return ret;
+}
+
+static void restore_on_signal(int sig)
+{
+	restore_device();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static void print_header(const struct bench_opts *opts)
+{
+	if (opts->csv) {
+		printf("strategy,readers,samples,samples_per_s,syscalls_per_sample,"
+		       "p50_us,p90_us,p99_us,p999_us,max_us,lost,dropped,drop_pct\n");
+		return;
+	}
+
+	printf("%-8s %7s %12s %10s %9s %9s %9s %9s %10s %8s\n", "strategy",
+	       "readers", "samples/s", "sys/sample", "p50_us", "p90_us",
+	       "p99_us", "p99.9_us", "max_us", "drop%");
+}
+
+static int run_strategy(int ctl, const struct bench_opts *opts,
+			enum strategy strategy)
+{
+	unsigned int nr = strategy == STRATEGY_MULTI ? opts->multi : 1;
+	uint64_t samples = 0, syscalls = 0, lost = 0, dropped = 0, start;
+	struct simtemp_ioctl_stats before, after;
+	struct bench_reader *readers;
+	struct lat_hist *lat;
+	double secs, us = 1000.0;
+	unsigned int i;
+	int err = 0;
+
+	readers = calloc(nr, sizeof(*readers));
+	lat = calloc(1, sizeof(*lat));
+	if (!readers || !lat) {
+		free(readers);
+		free(lat);
+		return -ENOMEM;
+	}
+
+	if (ioctl(ctl, SIMTEMP_IOC_GET_STATS, &before))
+		memset(&before, 0, sizeof(before));
+
+	pthread_barrier_init(&start_barrier, NULL, nr + 1);
+	for (i = 0; i < nr; i++) {
+		readers[i].opts = opts;
+		readers[i].strategy = strategy;
+		if (pthread_create(&readers[i].thread, NULL, reader_thread,
+				   &readers[i])) {
+			/* Nobody will ever reach the barrier for these */
+			fprintf(stderr, "pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	/* Everyone opened and drained their backlog: start the clock */
+	start = now_ns();
+	for (i = 0; i < nr; i++)
+		readers[i].deadline_ns = start + opts->seconds * 1000000000ULL;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].error && !err)
+			err = readers[i].error;
+		samples += readers[i].samples;
+		syscalls += readers[i].syscalls;
+		lost += readers[i].lost;
+		lat_merge(lat, &readers[i].lat);
+	}
+	secs = (now_ns() - start) / 1e9;
+	pthread_barrier_destroy(&start_barrier);
+
+	/* Samples the producer threw away under drop-newest */
+	if (!ioctl(ctl, SIMTEMP_IOC_GET_STATS, &after) &&
+	    after.dropped >= before.dropped)
+		dropped = after.dropped - before.dropped;
+
+	if (err) {
+		fprintf(stderr, "%s: %s\n", strategy_names[strategy],
+			strerror(-err));
+	} else {
+		double total = samples + lost + dropped * nr;
+		double drop_pct = total ? 100.0 * (lost + dropped * nr) / total :
+					  0.0;
+		double per_sample = samples ? (double)syscalls / samples : 0.0;
+
+		if (opts->csv)
+			printf("%s,%u,%" PRIu64 ",%.0f,%.4f,%.1f,%.1f,%.1f,%.1f,"
+			       "%.1f,%" PRIu64 ",%" PRIu64 ",%.4f\n",
+			       strategy_names[strategy], nr, samples,
+			       samples / secs, per_sample,
+			       lat_percentile(lat, samples, 50) / us,
+			       lat_percentile(lat, samples, 90) / us,
+			       lat_percentile(lat, samples, 99) / us,
+			       lat_percentile(lat, samples, 99.9) / us,
+			       lat->max / us, lost, dropped, drop_pct);
+		else
+			printf("%-8s %7u %12.0f %10.4f %9.1f %9.1f %9.1f %9.1f "
+			       "%10.1f %8.4f\n",
+			       strategy_names[strategy], nr, samples / secs,
+			       per_sample,
+			       lat_percentile(lat, samples, 50) / us,
+			       lat_percentile(lat, samples, 90) / us,
+			       lat_percentile(lat, samples, 99) / us,
+			       lat_percentile(lat, samples, 99.9) / us,
+			       lat->max / us, drop_pct);
+		fflush(stdout);
+	}
+
+	free(readers);
+	free(lat);
+	return err;
+}
+
+static int parse_strategies(struct bench_opts *opts, char *list)
+{
+	char *tok, *save = NULL;
+	int i;
+
+	memset(opts->strategies, 0, sizeof(opts->strategies));
+
+	for (tok = strtok_r(list, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(tok, "all")) {
+			for (i = 0; i < STRATEGY_MAX; i++)
+				opts->strategies[i] = true;
+			continue;
+		}
+
+		for (i = 0; i < STRATEGY_MAX; i++)
+			if (!strcmp(tok, strategy_names[i]))
+				break;
+		if (i == STRATEGY_MAX) {
+			fprintf(stderr, "Unknown strategy '%s'\n", tok);
+			return -EINVAL;
+		}
+		opts->strategies[i] = true;
+	}
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [OPTIONS]\n"
+	       "\n"
+	       "Options:\n"
+	       "  -d, --device PATH      Device node (default %s)\n"
+	       "  -t, --seconds N        Duration of each run (default %d)\n"
+	       "  -S, --strategy LIST    Comma-separated list of single, batch,\n"
+	       "                         poll, epoll, mmap, multi or all (default all)\n"
+	       "  -b, --batch N          Samples per read() (default %d)\n"
+	       "  -r, --multi N          Readers of the multi run (default %d)\n"
+	       "  -w, --watermark N      Per-reader wakeup watermark (default 1)\n"
+	       "  -s, --sampling-us N    Set the sampling period first\n"
+	       "  -c, --csv              Machine-readable output\n"
+	       "  -h, --help             Show this help\n",
+	       prog, BENCH_DEFAULT_DEVICE, BENCH_DEFAULT_SECONDS,
+	       BENCH_DEFAULT_BATCH, BENCH_DEFAULT_MULTI);
+}
+
+static unsigned int parse_uint(const char *arg, unsigned int min,
+			       unsigned int max, const char *what)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 0);
+	if (errno || *end || val < min || val > max) {
+		fprintf(stderr, "Invalid %s '%s' (%u-%u)\n", what, arg, min,
+			max);
+		exit(2);
+	}
+
+	return val;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_opts[] = {
+		{ "device", required_argument, NULL, 'd' },
+		{ "seconds", required_argument, NULL, 't' },
+		{ "strategy", required_argument, NULL, 'S' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "multi", required_argument, NULL, 'r' },
+		{ "watermark", required_argument, NULL, 'w' },
+		{ "sampling-us", required_argument, NULL, 's' },
+		{ "csv", no_argument, NULL, 'c' },
+		{ "help", no_argument, NULL, 'h' },
+		{}
+	};
+	struct bench_opts opts = {
+		.device = BENCH_DEFAULT_DEVICE,
+		.seconds = BENCH_DEFAULT_SECONDS,
+		.batch = BENCH_DEFAULT_BATCH,
+		.multi = BENCH_DEFAULT_MULTI,
+		.watermark = 1,
+	};
+	struct simtemp_config config;
+	int ctl, opt, i, err, ret = 0;
+
+	for (i = 0; i < STRATEGY_MAX; i++)
+		opts.strategies[i] = true;
+
+	while ((opt = getopt_long(argc, argv, "d:t:S:b:r:w:s:ch", long_opts,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'd':
+			opts.device = optarg;
+			break;
+		case 't':
+			opts.seconds = parse_uint(optarg, 1, 3600, "duration");
+			break;
+		case 'S':
+			if (parse_strategies(&opts, optarg))
+				return 2;
+			break;
+		case 'b':
+			opts.batch = parse_uint(optarg, 1, 1U << 20, "batch");
+			break;
+		case 'r':
+			opts.multi = parse_uint(optarg, 1, BENCH_MAX_READERS,
+						"reader count");
+			break;
+		case 'w':
+			opts.watermark = parse_uint(optarg, 1, 1U << 20,
+						    "watermark");
+			break;
+		case 's':
+			opts.sampling_us = parse_uint(optarg, 1, UINT32_MAX,
+						      "sampling period");
+			break;
+		case 'c':
+			opts.csv = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	ctl = open(opts.device, O_RDONLY | O_CLOEXEC);
+	if (ctl < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", opts.device,
+			strerror(errno));
+		return 1;
+	}
+
+	if (ioctl(ctl, SIMTEMP_IOC_GET_CONFIG, &saved.config)) {
+		perror("SIMTEMP_IOC_GET_CONFIG");
+		ret = 1;
+		goto out;
+	}
+
+	err = read_enabled(opts.device, &saved.enabled);
+	if (err) {
+		fprintf(stderr, "Cannot read the enable state of %s: %s\n",
+			opts.device, strerror(-err));
+		ret = 1;
+		goto out;
+	}
+
+	/* From here on, leave the device as it was found */
+	saved.fd = ctl;
+	signal(SIGINT, restore_on_signal);
+	signal(SIGTERM, restore_on_signal);
+
+	/*
+	 * One transition: no sample of an earlier configuration is left in
+	 * the ring, and the timer starts from a fresh phase.
+	 */
+	config = saved.config;
+	if (opts.sampling_us)
+		config.sampling_us = opts.sampling_us;
+	config.flags = SIMTEMP_CONFIG_APPLY | SIMTEMP_CONFIG_FLUSH |
+		       SIMTEMP_CONFIG_ENABLE;
+	if (ioctl(ctl, SIMTEMP_IOC_SET_CONFIG, &config)) {
+		perror("SIMTEMP_IOC_SET_CONFIG");
+		ret = 1;
+		goto out;
+	}
+
+	print_header(&opts);
+	for (i = 0; i < STRATEGY_MAX; i++) {
+		if (opts.strategies[i] && run_strategy(ctl, &opts, i))
+			ret = 1;
+	}
+
+out:
+	err = restore_device();
+	if (err) {
+		fprintf(stderr, "Cannot restore %s: %s\n", opts.device,
+			strerror(-err));
+		ret = 1;
+	}
+
+	close(ctl);
+	return ret;
+}
@@ -11,18 +11,57 @@ Copyright (c) 2025 Armando Mares
 
 import sys
 import os
+import glob
 import select
 import time
 import argparse
+import struct
 from datetime import datetime
 from typing import Optional, Tuple
 import fcntl
 
-from ctypes import c_uint32, c_int32, c_uint64, Structure, sizeof
+from ctypes import c_uint32, c_int32, c_uint64, c_int64, Structure, sizeof
+
+try:
+    import numpy
+except ImportError:  # bulk reads fall back to struct.iter_unpack()
+    numpy = None
+
+DEFAULT_DEVICE = "/dev/simtemp0"
+
+# struct simtemp_sample: packed, native byte order
+SAMPLE_FORMAT = "=QiI"
+SAMPLE_SIZE = struct.calcsize(SAMPLE_FORMAT)
+SAMPLE_DTYPE = numpy.dtype([
+    ("timestamp_ns", "=u8"),
+    ("temp_mC", "=i4"),
+    ("flags", "=u4"),
+]) if numpy is not None else None
+
+# SIMTEMP_FORMAT_COMPACT frames, see kernel/nxp_simtemp_ioctl.h
+COMPACT_RECORD_FORMAT = "=hH"
+COMPACT_RECORD_SIZE = struct.calcsize(COMPACT_RECORD_FORMAT)
+COMPACT_SYNC_FORMAT = "=hHIQi"
+COMPACT_SYNC_SIZE = struct.calcsize(COMPACT_SYNC_FORMAT)
+COMPACT_SYNC = -0x8000
+COMPACT_FLAGS = 0x7
+COMPACT_SHIFT = 3
+
+# Samples per read() in --batch and --rate-only monitoring
+DEFAULT_BATCH = 4096
+# Bytes spliced per call, the default pipe capacity
+CAPTURE_CHUNK = 65536
 
 SIMTEMP_IOC_MAGIC = ord('S')
 SIMTEMP_FLAG_NEW_SAMPLE = 1 << 0
 SIMTEMP_FLAG_THRESHOLD_CROSSED = 1 << 1
+SIMTEMP_FLAG_OVERRUN = 1 << 2
+SIMTEMP_READ_EVENTS_ONLY = 1 << 0
+SIMTEMP_CONFIG_APPLY = 1 << 0
+SIMTEMP_CONFIG_FLUSH = 1 << 1
+SIMTEMP_CONFIG_ENABLE = 1 << 2
+SIMTEMP_FORMAT_SAMPLE = 0
+SIMTEMP_FORMAT_COMPACT = 1
 
 
 # pylint: disable=invalid-name,redefined-builtin
@@ -51,6 +90,7 @@ def _IO(type, nr):
 SIMTEMP_MODE_NORMAL = 0
 SIMTEMP_MODE_NOISY = 1
 SIMTEMP_MODE_RAMP = 2
+SIMTEMP_MODE_REPLAY = 3
 
 
 # Define structures matching kernel
@@ -73,6 +113,7 @@ class SimtempConfig(Structure):
         ("threshold_mC", c_int32),  # pylint: disable=invalid-name
         ("mode", c_uint32),
         ("flags", c_uint32),
+        ("sampling_us", c_uint32),
     ]
 
 
@@ -85,6 +126,31 @@ class SimtempStats(Structure):
         ("poll_calls", c_uint64),
         ("last_error", c_int32),
         ("buffer_usage", c_uint32),
+        ("dropped", c_uint64),
+    ]
+
+
+class SimtempWindowStats(Structure):
+    """Kernel data structure for rolling window aggregates."""
+    _fields_ = [
+        ("window", c_uint32),
+        ("count", c_uint32),
+        ("min_mC", c_int32),  # pylint: disable=invalid-name
+        ("max_mC", c_int32),  # pylint: disable=invalid-name
+        ("sum_mC", c_int64),  # pylint: disable=invalid-name
+        ("sum_sq", c_uint64),
+        ("mean_mC", c_int32),  # pylint: disable=invalid-name
+        ("stddev_mC", c_uint32),  # pylint: disable=invalid-name
+    ]
+
+
+class SimtempAlert(Structure):
+    """Kernel data structure for pending threshold alerts."""
+    _fields_ = [
+        ("count", c_uint32),
+        ("seq", c_uint32),
+        ("above", c_uint32),
+        ("reserved", c_uint32),
     ]
 # pylint: enable=too-few-public-methods
 
@@ -97,38 +163,124 @@ SIMTEMP_IOC_RESET_STATS = _IO(SIMTEMP_IOC_MAGIC, 4)
 SIMTEMP_IOC_ENABLE = _IO(SIMTEMP_IOC_MAGIC, 5)
 SIMTEMP_IOC_DISABLE = _IO(SIMTEMP_IOC_MAGIC, 6)
 SIMTEMP_IOC_FLUSH_BUFFER = _IO(SIMTEMP_IOC_MAGIC, 7)
+SIMTEMP_IOC_SET_READ_FILTER = _IOW(SIMTEMP_IOC_MAGIC, 11, sizeof(c_uint32))
+SIMTEMP_IOC_GET_LATEST = _IOR(SIMTEMP_IOC_MAGIC, 12, sizeof(SimtempSample))
+SIMTEMP_IOC_SET_ALERT_EVENTFD = _IOW(SIMTEMP_IOC_MAGIC, 13, sizeof(c_int32))
+SIMTEMP_IOC_GET_ALERT = _IOR(SIMTEMP_IOC_MAGIC, 14, sizeof(SimtempAlert))
+SIMTEMP_IOC_SET_FORMAT = _IOW(SIMTEMP_IOC_MAGIC, 15, sizeof(c_uint32))
+SIMTEMP_IOC_GET_WINDOW_STATS = _IOR(SIMTEMP_IOC_MAGIC, 16,
+                                    sizeof(SimtempWindowStats))
 
 MODE_NAMES = {
     SIMTEMP_MODE_NORMAL: "normal",
     SIMTEMP_MODE_NOISY: "noisy",
-    SIMTEMP_MODE_RAMP: "ramp"
+    SIMTEMP_MODE_RAMP: "ramp",
+    SIMTEMP_MODE_REPLAY: "replay"
 }
 
 
+def decode_samples(buf, use_numpy=None):
+    """Decode whole simtemp_sample records from a bytes-like buffer.
+
+    Returns a numpy structured array viewing 'buf' when numpy is available
+    (or use_numpy is True), else a list of (timestamp_ns, temp_mC, flags)
+    tuples. Either way rec[0], rec[1] and rec[2] are the three fields. A
+    trailing partial record is ignored. The numpy result aliases 'buf', so
+    it is only valid until the buffer is reused.
+    """
+    view = memoryview(buf).cast("B")
+    count = len(view) // SAMPLE_SIZE
+    view = view[:count * SAMPLE_SIZE]
+
+    if use_numpy is None:
+        use_numpy = numpy is not None
+
+    if use_numpy:
+        return numpy.frombuffer(view, dtype=SAMPLE_DTYPE, count=count)
+
+    return list(struct.iter_unpack(SAMPLE_FORMAT, view))
+
+
+def decode_compact(buf):
+    """Decode a SIMTEMP_FORMAT_COMPACT read() into sample tuples.
+
+    Returns a list of (timestamp_ns, temp_mC, flags) like the struct
+    fallback of decode_samples(). Every read() starts with a sync frame,
+    so a buffer decodes on its own; a truncated trailing frame is ignored.
+    """
+    view = memoryview(buf).cast("B")
+    samples = []
+    timestamp = temp = period = 0
+    pos = 0
+
+    while pos + COMPACT_RECORD_SIZE <= len(view):
+        dtemp, info = struct.unpack_from(COMPACT_RECORD_FORMAT, view, pos)
+        if dtemp == COMPACT_SYNC:
+            if pos + COMPACT_SYNC_SIZE > len(view):
+                break
+            _, flags, period, timestamp, temp = struct.unpack_from(
+                COMPACT_SYNC_FORMAT, view, pos)
+            pos += COMPACT_SYNC_SIZE
+        else:
+            # The top 13 bits of 'info' are signed microseconds of drift
+            drift_us = (info - 0x10000 if info & 0x8000 else info) \
+                >> COMPACT_SHIFT
+            timestamp += period + drift_us * 1000
+            temp += dtemp
+            flags = info & COMPACT_FLAGS
+            pos += COMPACT_RECORD_SIZE
+        samples.append((timestamp, temp, flags))
+
+    return samples
+
+
+def summarize_samples(samples):
+    """Count, min/max/sum of temp_mC, alerts and overruns of a batch"""
+    count = len(samples)
+    if not count:
+        return 0, None, None, 0, 0, 0
+
+    if numpy is not None and isinstance(samples, numpy.ndarray):
+        temps = samples["temp_mC"]
+        flags = samples["flags"]
+        return (count, int(temps.min()), int(temps.max()),
+                int(temps.sum(dtype=numpy.int64)),
+                int(numpy.count_nonzero(
+                    flags & SIMTEMP_FLAG_THRESHOLD_CROSSED)),
+                int(numpy.count_nonzero(flags & SIMTEMP_FLAG_OVERRUN)))
+
+    temps = [rec[1] for rec in samples]
+    return (count, min(temps), max(temps), sum(temps),
+            sum(1 for rec in samples
+                if rec[2] & SIMTEMP_FLAG_THRESHOLD_CROSSED),
+            sum(1 for rec in samples if rec[2] & SIMTEMP_FLAG_OVERRUN))
+
+
+def default_device_path():
+    """Pick /dev/simtemp0, or the first simtemp instance that exists"""
+    if os.path.exists(DEFAULT_DEVICE):
+        return DEFAULT_DEVICE
+
+    devices = sorted(glob.glob("/dev/simtemp*"))
+    return devices[0] if devices else DEFAULT_DEVICE
+
+
 class SimtempDevice:
     """Interface to the simtemp device"""
 
-    def __init__(self, device_path="/dev/simtemp"):
-        self.device_path = device_path
+    def __init__(self, device_path=None):
+        self.device_path = device_path or default_device_path()
         self.fd = None
+        self._read_buf = None
+        self.compact = False
         self.sysfs_base = self._find_sysfs_path()
 
     def _find_sysfs_path(self):
-        """Find the sysfs path for the simtemp device"""
-        # Try common locations
-        possible_paths = [
-            "/sys/class/misc/simtemp",
-            "/sys/devices/platform/nxp-simtemp/misc/simtemp",
-            "/sys/devices/platform/nxp-simtemp.-1/misc/simtemp"
-        ]
-
-        for path in possible_paths:
-            if os.path.exists(path):
-                return path
-
-        # If not found, return a default and let individual operations fail
-        # gracefully
-        return "/sys/class/misc/simtemp"
+        """Find the sysfs directory of the misc device behind device_path"""
+        # Each instance has its attributes under its own misc class entry;
+        # if it is missing, individual operations fail gracefully
+        name = os.path.basename(os.path.realpath(self.device_path))
+        return os.path.join("/sys/class/misc", name)
 
     def open(self):
         """Open the device"""
@@ -177,6 +329,41 @@ class SimtempDevice:
         except OSError:
             return None
 
+    def read_samples(self, count, timeout=None):
+        """Read up to 'count' samples with a single read() call.
+
+        The samples land in a buffer preallocated on first use and are
+        decoded in place by decode_samples(). Returns None on timeout or
+        error. A numpy result is overwritten by the next call.
+        """
+        if self.fd is None or count < 1:
+            return None
+
+        if self.compact:
+            size = max(count * COMPACT_RECORD_SIZE, COMPACT_SYNC_SIZE)
+        else:
+            size = count * SAMPLE_SIZE
+        if self._read_buf is None or len(self._read_buf) < size:
+            self._read_buf = bytearray(size)
+
+        try:
+            if timeout is not None:
+                ready, _, _ = select.select([self.fd], [], [], timeout)
+                if not ready:
+                    return None
+
+            nread = os.readv(self.fd, [memoryview(self._read_buf)[:size]])
+        except OSError:
+            return None
+
+        if self.compact:
+            samples = decode_compact(memoryview(self._read_buf)[:nread])
+            if numpy is not None:
+                return numpy.array(samples, dtype=SAMPLE_DTYPE)
+            return samples
+
+        return decode_samples(memoryview(self._read_buf)[:nread])
+
     def set_sysfs_value(self, attribute, value):
         """Set a sysfs attribute value"""
         try:
@@ -202,6 +389,10 @@ class SimtempDevice:
         """Set sampling period via sysfs"""
         return self.set_sysfs_value("sampling_ms", period_ms)
 
+    def set_sampling_period_us(self, period_us):
+        """Set sampling period in microseconds via sysfs"""
+        return self.set_sysfs_value("sampling_us", period_us)
+
     def set_threshold(self, threshold_mc):
         """Set temperature threshold via sysfs"""
         return self.set_sysfs_value("threshold_mC", threshold_mc)
@@ -210,6 +401,23 @@ class SimtempDevice:
         """Set simulation mode via sysfs"""
         return self.set_sysfs_value("mode", mode)
 
+    def load_trace(self, temps_mc):
+        """Upload a replay trace; it becomes active when the file closes"""
+        data = struct.pack(f"={len(temps_mc)}i", *temps_mc)
+        try:
+            fd = os.open(self.device_path, os.O_WRONLY)
+            try:
+                view = memoryview(data)
+                while view:
+                    written = os.write(fd, view)
+                    view = view[written:]
+            finally:
+                os.close(fd)
+            return True
+        except OSError as e:
+            print(f"Error loading trace: {e}")
+            return False
+
     def enable_device(self):
         """Enable the device via sysfs"""
         return self.set_sysfs_value("enabled", "1")
@@ -240,7 +448,8 @@ class SimtempDevice:
 
         return stats
 
-    def ioctl_set_config(self, sampling_ms, threshold_mc, mode):
+    def ioctl_set_config(self, sampling_ms, threshold_mc, mode, flags=0,
+                         sampling_us=0):
         """Set configuration via ioctl"""
         if self.fd is None:
             return False
@@ -253,7 +462,8 @@ class SimtempDevice:
             config.sampling_ms = sampling_ms
             config.threshold_mC = threshold_mc
             config.mode = mode
-            config.flags = 0
+            config.flags = flags
+            config.sampling_us = sampling_us
             # pylint: enable=attribute-defined-outside-init,invalid-name
 
             fcntl.ioctl(self.fd, SIMTEMP_IOC_SET_CONFIG, config)
@@ -272,6 +482,7 @@ class SimtempDevice:
             fcntl.ioctl(self.fd, SIMTEMP_IOC_GET_CONFIG, config)
             return {
                 'sampling_ms': config.sampling_ms,
+                'sampling_us': config.sampling_us,
                 'threshold_mC': config.threshold_mC,
                 'mode': config.mode
             }
@@ -279,6 +490,26 @@ class SimtempDevice:
             print(f"IOCTL get config error: {e}")
             return None
 
+    def apply_config(self, sampling_us=None, threshold_mc=None, mode=None):
+        """Change the config, flush and (re)start sampling in one call.
+
+        Unset values keep their current setting. The driver stops, applies,
+        drops every queued sample and restarts with a fresh timer phase, so
+        no sample of the old configuration is read afterwards.
+        """
+        current = self.ioctl_get_config()
+        if current is None:
+            return False
+
+        return self.ioctl_set_config(
+            0,
+            current['threshold_mC'] if threshold_mc is None else threshold_mc,
+            current['mode'] if mode is None else mode,
+            flags=(SIMTEMP_CONFIG_APPLY | SIMTEMP_CONFIG_FLUSH |
+                   SIMTEMP_CONFIG_ENABLE),
+            sampling_us=(current['sampling_us'] if sampling_us is None
+                         else sampling_us))
+
     def flush_buffer(self):
         """Flush the ring buffer via ioctl"""
         if self.fd is None:
@@ -291,6 +522,79 @@ class SimtempDevice:
             print(f"IOCTL flush buffer error: {e}")
             return False
 
+    def get_latest(self) -> Optional[Tuple[datetime, float, int]]:
+        """Current temperature, without consuming any queued sample"""
+        if self.fd is None:
+            return None
+
+        try:
+            sample = SimtempSample()
+            fcntl.ioctl(self.fd, SIMTEMP_IOC_GET_LATEST, sample)
+        except OSError as e:
+            print(f"IOCTL get latest error: {e}")
+            return None
+
+        timestamp = datetime.fromtimestamp(sample.timestamp_ns / 1e9)
+        return timestamp, sample.temp_mC / 1000.0, sample.flags
+
+    def set_events_only(self, events_only=True):
+        """Only receive (and wake for) threshold-crossing samples"""
+        if self.fd is None:
+            return False
+
+        try:
+            flags = SIMTEMP_READ_EVENTS_ONLY if events_only else 0
+            fcntl.ioctl(self.fd, SIMTEMP_IOC_SET_READ_FILTER,
+                        c_uint32(flags))
+            return True
+        except OSError as e:
+            print(f"IOCTL set read filter error: {e}")
+            return False
+
+    def get_window_stats(self):
+        """Rolling window aggregates as a dict, in one ioctl"""
+        if self.fd is None:
+            return None
+
+        try:
+            ws = SimtempWindowStats()
+            fcntl.ioctl(self.fd, SIMTEMP_IOC_GET_WINDOW_STATS, ws)
+        except OSError as e:
+            print(f"IOCTL get window stats error: {e}")
+            return None
+
+        # pylint: disable-next=protected-access
+        return {name: getattr(ws, name) for name, _ in ws._fields_}
+
+    def set_compact(self, compact=True):
+        """Switch read() to the delta-encoded SIMTEMP_FORMAT_COMPACT"""
+        if self.fd is None:
+            return False
+
+        try:
+            fmt = SIMTEMP_FORMAT_COMPACT if compact else SIMTEMP_FORMAT_SAMPLE
+            fcntl.ioctl(self.fd, SIMTEMP_IOC_SET_FORMAT, c_uint32(fmt))
+        except OSError as e:
+            print(f"IOCTL set format error: {e}")
+            return False
+
+        self.compact = compact
+        return True
+
+    def get_alert(self) -> Optional[Tuple[int, bool]]:
+        """Acknowledge pending alerts: (crossings since last call, above)"""
+        if self.fd is None:
+            return None
+
+        try:
+            alert = SimtempAlert()
+            fcntl.ioctl(self.fd, SIMTEMP_IOC_GET_ALERT, alert)
+        except OSError as e:
+            print(f"IOCTL get alert error: {e}")
+            return None
+
+        return alert.count, bool(alert.above)
+
 
 def format_sample(timestamp, temp_c, flags):
     """Format a temperature sample for display"""
@@ -333,6 +637,200 @@ def monitor_temperature(device, duration=None, max_samples=None):
     return sample_count
 
 
+def monitor_batched(device, batch, rate_only=False, duration=None,
+                    max_samples=None):
+    """Monitor with bulk reads of up to 'batch' samples.
+
+    Prints every sample, or with 'rate_only' a one-line summary per
+    second, which keeps up with the driver at rates where formatting each
+    sample would not.
+    """
+    print("Monitoring temperature... (Ctrl+C to stop)")
+    if rate_only:
+        print("Samples/s   Min(C)   Max(C)  Mean(C)  Alerts  Overruns")
+    else:
+        print("Timestamp                    Temperature  Alert")
+    print("-" * 55)
+
+    sample_count = 0
+    start_time = time.time()
+    window_start = start_time
+    window = [0, None, None, 0, 0, 0]
+
+    def print_window(now):
+        count, low, high, total, alerts, overruns = window
+        rate = count / (now - window_start)
+        if count:
+            print(f"{rate:9.0f} {low / 1000:8.1f} {high / 1000:8.1f} "
+                  f"{total / count / 1000:8.1f} {alerts:7d} {overruns:9d}")
+        else:
+            print(f"{rate:9.0f}        -        -        - "
+                  f"{alerts:7d} {overruns:9d}")
+
+    try:
+        while True:
+            now = time.time()
+            if duration is not None and (now - start_time) >= duration:
+                break
+            if max_samples is not None and sample_count >= max_samples:
+                break
+
+            if rate_only and now - window_start >= 1.0:
+                print_window(now)
+                window_start = now
+                window = [0, None, None, 0, 0, 0]
+
+            want = batch
+            if max_samples is not None:
+                want = min(want, max_samples - sample_count)
+
+            samples = device.read_samples(want, timeout=1.0)
+            if samples is None or len(samples) == 0:
+                continue
+            sample_count += len(samples)
+
+            if not rate_only:
+                for rec in samples:
+                    print(format_sample(
+                        datetime.fromtimestamp(int(rec[0]) / 1e9),
+                        int(rec[1]) / 1000.0, int(rec[2])))
+                continue
+
+            count, low, high, total, alerts, overruns = \
+                summarize_samples(samples)
+            window[0] += count
+            window[1] = low if window[1] is None else min(window[1], low)
+            window[2] = high if window[2] is None else max(window[2], high)
+            window[3] += total
+            window[4] += alerts
+            window[5] += overruns
+
+    except KeyboardInterrupt:
+        print("\nMonitoring stopped by user")
+
+    if rate_only and window[0]:
+        print_window(time.time())
+
+    return sample_count
+
+
+def capture_stream(device, path, duration=None):
+    """Archive the raw sample stream to 'path' without copying it here.
+
+    Samples are spliced from the device into a pipe and from the pipe on
+    to the file, so they never pass through user space; the loop only
+    waits for data. Returns the number of bytes written.
+    """
+    if not hasattr(os, "splice"):
+        print("Capture needs os.splice() (Python 3.10 or later)")
+        return None
+
+    try:
+        out = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+    except OSError as e:
+        print(f"Error opening {path}: {e}")
+        return None
+
+    pipe_r, pipe_w = os.pipe()
+    poller = select.poll()
+    poller.register(device.fd, select.POLLIN)
+    written = 0
+
+    print(f"Capturing to {path}... (Ctrl+C to stop)")
+    start_time = time.time()
+
+    try:
+        while True:
+            timeout = 1.0
+            if duration is not None:
+                timeout = duration - (time.time() - start_time)
+                if timeout <= 0:
+                    break
+
+            if not poller.poll(min(timeout, 1.0) * 1000):
+                continue
+
+            try:
+                pending = os.splice(device.fd, pipe_w, CAPTURE_CHUNK)
+            except BlockingIOError:
+                continue
+
+            while pending:
+                moved = os.splice(pipe_r, out, pending)
+                pending -= moved
+                written += moved
+
+    except KeyboardInterrupt:
+        print("\nCapture stopped by user")
+    except OSError as e:
+        print(f"Capture failed: {e}")
+    finally:
+        os.close(pipe_r)
+        os.close(pipe_w)
+        os.close(out)
+
+    return written
+
+
+def watch_alerts(paths, duration=None):
+    """Wait for threshold crossings on all 'paths' in one epoll set.
+
+    Only EPOLLPRI is requested, so the loop sleeps through the sample
+    stream and wakes for alerts alone; no samples are read or consumed.
+    """
+    devices = {}
+    epoll = select.epoll()
+    crossings = 0
+
+    try:
+        for path in paths:
+            device = SimtempDevice(path)
+            if not device.open():
+                continue
+            # Crossings before we started watching are not interesting
+            device.get_alert()
+            epoll.register(device.fd, select.EPOLLPRI)
+            devices[device.fd] = device
+
+        if not devices:
+            return 0
+
+        print(f"Watching {len(devices)} device(s) for threshold "
+              f"crossings... (Ctrl+C to stop)")
+        start_time = time.time()
+
+        while True:
+            timeout = 1.0
+            if duration is not None:
+                timeout = duration - (time.time() - start_time)
+                if timeout <= 0:
+                    break
+
+            for fd, _ in epoll.poll(min(timeout, 1.0)):
+                device = devices[fd]
+                result = device.get_alert()
+                if result is None or not result[0]:
+                    continue
+
+                count, above = result
+                crossings += count
+                latest = device.get_latest()
+                temp = f"{latest[1]:.1f}C" if latest else "?"
+                print(f"{datetime.now().strftime('%H:%M:%S.%f')[:-3]} "
+                      f"{device.device_path}: {count} crossing(s), now "
+                      f"{'above' if above else 'below'} threshold "
+                      f"(temp={temp})")
+
+    except KeyboardInterrupt:
+        print("\nWatching stopped by user")
+    finally:
+        epoll.close()
+        for device in devices.values():
+            device.close()
+
+    return crossings
+
+
 def test_threshold_alert(device, test_threshold=None):
     """Test threshold alert functionality"""
     print("Testing threshold alert functionality...")
@@ -399,28 +897,87 @@ def test_threshold_alert(device, test_threshold=None):
         return False
 
 
+def load_trace_file(path):
+    """Read a replay trace: one temp_mC per line, '#' starts a comment"""
+    temps_mc = []
+    with open(path, 'r', encoding='utf-8') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if line:
+                temps_mc.append(int(line))
+    return temps_mc
+
+
 # pylint: disable=too-many-return-statements,too-many-branches,too-many-statements
 # CLI entry point requires comprehensive argument handling
 def main():
     """CLI entry point for simtemp device operations."""
     parser = argparse.ArgumentParser(description="NXP Simtemp CLI Application")
-    parser.add_argument("--device", default="/dev/simtemp", help="Device path")
+    parser.add_argument(
+        "--device",
+        default=None,
+        help=f"Device path (default: {DEFAULT_DEVICE})")
     parser.add_argument(
         "--sampling",
         type=int,
         help="Set sampling period (ms)")
+    parser.add_argument(
+        "--sampling-us",
+        type=int,
+        help="Set sampling period (us, 10 us minimum)")
     parser.add_argument(
         "--threshold",
         type=float,
         help="Set threshold temperature (°C)")
+    parser.add_argument(
+        "--hysteresis",
+        type=float,
+        help="Set threshold hysteresis (°C)")
+    parser.add_argument(
+        "--timer-slack",
+        type=int,
+        metavar="US",
+        help="Let the sampling timer coalesce within US microseconds (0 = exact)")
+    parser.add_argument(
+        "--timer-align",
+        type=int,
+        choices=[0, 1],
+        help="Tick on the shared period grid (1) or relative to enable (0)")
     parser.add_argument(
         "--mode",
         choices=[
             "normal",
             "noisy",
-            "ramp"],
+            "ramp",
+            "replay"],
         help="Set simulation mode")
+    parser.add_argument(
+        "--filter",
+        choices=[
+            "none",
+            "decimate",
+            "boxcar",
+            "ema",
+            "minmax"],
+        help="Set the in-driver filter stage")
+    parser.add_argument(
+        "--filter-window",
+        type=int,
+        help="Raw samples per filtered output")
+    parser.add_argument(
+        "--load-trace",
+        metavar="FILE",
+        help="Upload a replay trace (one temp_mC value per line)")
+    parser.add_argument(
+        "--replay-us",
+        type=int,
+        help="Set replay period (us, 0 follows the sampling period)")
     parser.add_argument("--enable", action="store_true", help="Enable device")
+    parser.add_argument(
+        "--restart",
+        action="store_true",
+        help="Apply --sampling/--sampling-us/--threshold/--mode atomically, "
+             "flush queued samples and (re)start sampling")
     parser.add_argument(
         "--disable",
         action="store_true",
@@ -429,6 +986,35 @@ def main():
         "--monitor",
         action="store_true",
         help="Monitor temperature readings")
+    parser.add_argument(
+        "--batch",
+        type=int,
+        nargs="?",
+        const=DEFAULT_BATCH,
+        metavar="N",
+        help=f"Monitor with bulk reads of up to N samples "
+             f"(default {DEFAULT_BATCH})")
+    parser.add_argument(
+        "--rate-only",
+        action="store_true",
+        help="Monitor with bulk reads, printing a summary per second")
+    parser.add_argument(
+        "--compact",
+        action="store_true",
+        help="Monitor with bulk reads in the delta-encoded stream format")
+    parser.add_argument(
+        "--capture",
+        metavar="FILE",
+        help="Splice the raw stream (compact with --compact) into FILE")
+    parser.add_argument(
+        "--events-only",
+        action="store_true",
+        help="Monitor threshold crossings only")
+    parser.add_argument(
+        "--watch-alerts",
+        action="store_true",
+        help="Wait for threshold crossings on every simtemp instance "
+             "(the --device one if given), without reading samples")
     parser.add_argument(
         "--duration",
         type=float,
@@ -445,10 +1031,23 @@ def main():
         "--test-threshold",
         type=float,
         help="Threshold for test (°C)")
+    parser.add_argument(
+        "--latest",
+        action="store_true",
+        help="Show the current temperature without consuming samples")
     parser.add_argument(
         "--stats",
         action="store_true",
         help="Show device statistics")
+    parser.add_argument(
+        "--stats-window",
+        type=int,
+        metavar="N",
+        help="Keep rolling aggregates over the last N samples (0 = off)")
+    parser.add_argument(
+        "--window-stats",
+        action="store_true",
+        help="Show the rolling window aggregates")
     parser.add_argument(
         "--config",
         action="store_true",
@@ -460,11 +1059,36 @@ def main():
     device = SimtempDevice(args.device)
 
     # Check if device exists
-    if not os.path.exists(args.device):
-        print(f"Error: Device {args.device} not found")
+    if not os.path.exists(device.device_path):
+        print(f"Error: Device {device.device_path} not found")
         print("Make sure the nxp_simtemp module is loaded")
         return 1
 
+    # One SET_CONFIG transition instead of separate sysfs writes
+    if args.restart:
+        sampling_us = args.sampling_us
+        if sampling_us is None and args.sampling is not None:
+            sampling_us = args.sampling * 1000
+        mode = None
+        if args.mode is not None:
+            mode = {name: num for num, name in MODE_NAMES.items()}[args.mode]
+        threshold_mc = None
+        if args.threshold is not None:
+            threshold_mc = int(args.threshold * 1000)
+
+        if not device.open():
+            return 1
+        try:
+            applied = device.apply_config(sampling_us, threshold_mc, mode)
+        finally:
+            device.close()
+
+        if not applied:
+            print("Failed to apply configuration")
+            return 1
+        print("Configuration applied, buffer flushed, sampling (re)started")
+        args.sampling = args.sampling_us = args.threshold = args.mode = None
+
     # Configuration operations (don't require device to be open)
     if args.sampling is not None:
         if device.set_sampling_period(args.sampling):
@@ -473,6 +1097,13 @@ def main():
             print("Failed to set sampling period")
             return 1
 
+    if args.sampling_us is not None:
+        if device.set_sampling_period_us(args.sampling_us):
+            print(f"Sampling period set to {args.sampling_us} us")
+        else:
+            print("Failed to set sampling period")
+            return 1
+
     if args.threshold is not None:
         threshold_mc = int(args.threshold * 1000)
         if device.set_threshold(threshold_mc):
@@ -481,6 +1112,68 @@ def main():
             print("Failed to set threshold")
             return 1
 
+    if args.hysteresis is not None:
+        hysteresis_mc = int(args.hysteresis * 1000)
+        if device.set_sysfs_value("hysteresis_mC", hysteresis_mc):
+            print(f"Hysteresis set to {args.hysteresis:.1f}°C")
+        else:
+            print("Failed to set hysteresis")
+            return 1
+
+    if args.timer_slack is not None:
+        if device.set_sysfs_value("timer_slack_us", args.timer_slack):
+            print(f"Timer slack set to {args.timer_slack} us")
+        else:
+            print("Failed to set timer slack")
+            return 1
+
+    if args.timer_align is not None:
+        if device.set_sysfs_value("timer_align", args.timer_align):
+            print(f"Timer alignment {'on' if args.timer_align else 'off'}")
+        else:
+            print("Failed to set timer alignment")
+            return 1
+
+    if args.filter_window is not None:
+        if device.set_sysfs_value("filter_window", args.filter_window):
+            print(f"Filter window set to {args.filter_window} samples")
+        else:
+            print("Failed to set filter window")
+            return 1
+
+    if args.filter is not None:
+        if device.set_sysfs_value("filter", args.filter):
+            print(f"Filter set to {args.filter}")
+        else:
+            print("Failed to set filter")
+            return 1
+
+    if args.load_trace is not None:
+        try:
+            temps_mc = load_trace_file(args.load_trace)
+        except (OSError, ValueError) as e:
+            print(f"Failed to read trace: {e}")
+            return 1
+
+        if not temps_mc or not device.load_trace(temps_mc):
+            print("Failed to load trace")
+            return 1
+        print(f"Loaded {len(temps_mc)} trace samples")
+
+    if args.replay_us is not None:
+        if device.set_sysfs_value("replay_us", args.replay_us):
+            print(f"Replay period set to {args.replay_us} us")
+        else:
+            print("Failed to set replay period")
+            return 1
+
+    if args.stats_window is not None:
+        if device.set_sysfs_value("stats_window", args.stats_window):
+            print(f"Stats window set to {args.stats_window} samples")
+        else:
+            print("Failed to set stats window")
+            return 1
+
     if args.mode is not None:
         if device.set_mode(args.mode):
             print(f"Mode set to {args.mode}")
@@ -514,7 +1207,8 @@ def main():
 
     if args.config:
         print("Current Configuration:")
-        for attr in ["sampling_ms", "threshold_mC", "mode", "enabled"]:
+        for attr in ["sampling_ms", "sampling_us", "threshold_mC", "mode",
+                     "enabled"]:
             value = device.get_sysfs_value(attr)
             if value is not None:
                 if attr == "threshold_mC":
@@ -525,6 +1219,67 @@ def main():
                 print(f"  {attr}: <unable to read>")
 
     # Operations that require device to be open
+    if args.latest:
+        if not device.open():
+            return 1
+
+        try:
+            result = device.get_latest()
+        finally:
+            device.close()
+
+        if result is None:
+            print("No sample available yet")
+            return 1
+        print(format_sample(*result))
+
+    if args.watch_alerts:
+        paths = [args.device] if args.device else \
+            sorted(glob.glob("/dev/simtemp*"))
+        crossings = watch_alerts(paths, args.duration)
+        print(f"\nSaw {crossings} threshold crossings")
+
+    if args.window_stats:
+        if not device.open():
+            return 1
+
+        try:
+            ws = device.get_window_stats()
+        finally:
+            device.close()
+
+        if ws is None:
+            return 1
+        if not ws["window"]:
+            print("Stats window disabled (see --stats-window)")
+        else:
+            print(f"Window Statistics (last {ws['count']} of "
+                  f"{ws['window']} samples):")
+            if ws["count"]:
+                print(f"  min:    {ws['min_mC'] / 1000:.3f}°C")
+                print(f"  max:    {ws['max_mC'] / 1000:.3f}°C")
+                print(f"  mean:   {ws['mean_mC'] / 1000:.3f}°C")
+                print(f"  stddev: {ws['stddev_mC'] / 1000:.3f}°C")
+
+    if args.batch is not None and args.batch < 1:
+        print("--batch needs at least one sample per read")
+        return 1
+
+    if args.capture:
+        if not device.open():
+            return 1
+
+        try:
+            if args.compact and not device.set_compact():
+                return 1
+            written = capture_stream(device, args.capture, args.duration)
+        finally:
+            device.close()
+
+        if written is None:
+            return 1
+        print(f"\nWrote {written} bytes to {args.capture}")
+
     if args.monitor or args.test:
         if not device.open():
             return 1
@@ -539,8 +1294,17 @@ def main():
                 return 0 if success else 1
 
             if args.monitor:
-                sample_count = monitor_temperature(
-                    device, args.duration, args.samples)
+                if args.events_only and not device.set_events_only():
+                    return 1
+                if args.compact and not device.set_compact():
+                    return 1
+                if args.batch is not None or args.rate_only or args.compact:
+                    sample_count = monitor_batched(
+                        device, args.batch or DEFAULT_BATCH,
+                        args.rate_only, args.duration, args.samples)
+                else:
+                    sample_count = monitor_temperature(
+                        device, args.duration, args.samples)
                 print(f"\nRead {sample_count} samples")
 
         finally:
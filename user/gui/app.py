@@ -12,16 +12,14 @@ Copyright (c) 2025 Armando Mares
 import os
 import sys
 import threading
-from collections import deque
-from datetime import datetime, timedelta
+from datetime import datetime
 import tkinter as tk
 from tkinter import ttk, messagebox
 
 import matplotlib.pyplot as plt
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
-from matplotlib.animation import FuncAnimation
+from matplotlib.ticker import MaxNLocator
 import numpy as np
-from scipy.interpolate import make_interp_spline
 
 # Import the CLI module for device interface
 cli_path = os.path.join(
@@ -34,6 +32,84 @@ except ImportError:
     print(f"Searched in: {cli_path}")
     sys.exit(1)
 
+# Samples kept for the plot: about 17 minutes at 1 kHz, 24 MiB
+PLOT_HISTORY = 1 << 20
+# Samples per read() in the monitor thread
+READ_BATCH = 4096
+# Plot refresh period (ms), independent of the sampling rate
+PLOT_INTERVAL_MS = 33
+
+
+class PlotRing:
+    """Fixed-size plot history of (seconds, °C) pairs.
+
+    Every sample is stored twice, at slot i and i + capacity, so the newest
+    samples are always one contiguous slice and decimation never has to
+    copy or reorder the history. Memory and per-frame work are bounded by
+    'capacity' however long the capture runs. The monitor thread appends
+    while the GUI thread decimates, hence the lock.
+    """
+
+    def __init__(self, capacity):
+        self.capacity = capacity
+        self.times = np.zeros(2 * capacity, dtype=np.float64)
+        self.temps = np.zeros(2 * capacity, dtype=np.float32)
+        self.head = 0  # next slot to write
+        self.count = 0
+        self.lock = threading.Lock()
+
+    def clear(self):
+        """Drop the whole history"""
+        with self.lock:
+            self.head = 0
+            self.count = 0
+
+    def _store(self, start, times, temps):
+        for base in (start, start + self.capacity):
+            self.times[base:base + len(times)] = times
+            self.temps[base:base + len(temps)] = temps
+
+    def extend(self, times, temps):
+        """Append a batch of samples, overwriting the oldest when full"""
+        times = times[-self.capacity:]
+        temps = temps[-self.capacity:]
+        count = len(times)
+
+        with self.lock:
+            first = min(count, self.capacity - self.head)
+            self._store(self.head, times[:first], temps[:first])
+            self._store(0, times[first:], temps[first:])
+            self.head = (self.head + count) % self.capacity
+            self.count = min(self.count + count, self.capacity)
+
+    def decimate(self, width):
+        """The history reduced to at most 2 * width points.
+
+        Each of 'width' bins contributes its minimum and maximum, so a spike
+        stays visible however many samples one pixel covers. Returns
+        (x, y, t_first, t_last), or None while empty.
+        """
+        with self.lock:
+            if not self.count:
+                return None
+
+            start = (self.head - self.count) % self.capacity
+            times = self.times[start:start + self.count]
+            temps = self.temps[start:start + self.count]
+            t_first, t_last = float(times[0]), float(times[-1])
+
+            if self.count <= 2 * width:
+                return times.copy(), temps.copy(), t_first, t_last
+
+            # Whole bins only; the few oldest samples left over are skipped
+            per_bin = self.count // width
+            used = per_bin * width
+            bins = temps[-used:].reshape(width, per_bin)
+            x = np.repeat(times[-used::per_bin], 2)
+            y = np.column_stack((bins.min(axis=1), bins.max(axis=1))).ravel()
+
+        return x, y, t_first, t_last
+
 
 # pylint: disable=too-many-instance-attributes,too-many-public-methods
 # pylint: disable=attribute-defined-outside-init
@@ -53,20 +129,9 @@ class SimtempGUI:
         self.monitoring = False
         self.monitor_thread = None
 
-        # Data storage with smoothing
-        self.max_samples = 100
-        self.timestamps = deque(maxlen=self.max_samples)
-        self.temperatures = deque(maxlen=self.max_samples)
-        self.alerts = deque(maxlen=self.max_samples)
-
-        # Smoothing parameters
-        self.smooth_temperatures = deque(maxlen=self.max_samples)
-        self.alpha = 0.3  # Exponential smoothing (lower = smoother)
-
-        # Dynamic timing parameters
-        self.start_timestamp = None  # First timestamp for relative time
-        self.current_sampling_ms = None  # Current driver sampling
-        self.gui_update_interval = 33  # Default 30 FPS
+        # Plot history, constant size whatever the capture length
+        self.plot_ring = PlotRing(PLOT_HISTORY)
+        self.start_ns = None  # timestamp_ns of the first sample, time zero
 
         # Current values
         self.current_temp = tk.StringVar(value="--.-°C")
@@ -86,9 +151,6 @@ class SimtempGUI:
         # Set up plot animation
         self.setup_plot()
 
-        # Perform initial frame rate adaptation
-        self.check_and_adapt_framerate()
-
     def setup_ui(self):
         """Setup the user interface"""
         # Main notebook for tabs
@@ -420,13 +482,12 @@ class SimtempGUI:
             color='#bdc3c7')
         self.ax.minorticks_on()
 
-        # Temperature line - reduced markers for smoother rendering
+        # Temperature line, animated so it is left out of the cached
+        # background and blitted on its own every frame
         self.temp_line, = self.ax.plot(
-            [], [], color='#3498db', linewidth=2.5,
-            label='Temperature', marker='o', markersize=3,
-            markerfacecolor='#3498db', markeredgecolor='white',
-            markeredgewidth=0.5, alpha=0.9, markevery=2,
-            antialiased=True)
+            [], [], color='#3498db', linewidth=1.5,
+            label='Temperature', alpha=0.9, antialiased=True,
+            animated=True)
 
         # Prominent threshold line
         self.threshold_line = self.ax.axhline(
@@ -454,228 +515,85 @@ class SimtempGUI:
         self.ax.set_xlim(0, 1)
         self.ax.set_ylim(20, 50)
 
-        # Track last update for throttling
-        self.last_xlim = None
-        self.last_ylim = None
-        self.update_counter = 0
-
-        # Dynamic frame rate adaptation
-        self.current_sampling_ms = 10  # Default value
-        self.last_sampling_check = datetime.now()
-        self.adaptive_interval = 33  # Start with 30 FPS
-
-        # Set up animation with dynamic interval
-        self.anim = FuncAnimation(self.fig, self.update_plot, interval=33,
-                                  blit=False, cache_frame_data=False)
-
-    def check_and_adapt_framerate(self):
-        """Dynamically adapt GUI update rate to match driver sampling period"""
-        now = datetime.now()
-
-        # Check sampling period every 2 seconds to avoid overhead
-        if (now - self.last_sampling_check).total_seconds() < 2.0:
-            return
-
-        self.last_sampling_check = now
+        # Tick style is set once; the locators follow the limits
+        self.ax.xaxis.set_major_locator(MaxNLocator(nbins=8, integer=True))
+        self.ax.xaxis.set_major_formatter(
+            plt.FuncFormatter(lambda x, p: f'{int(x)}s'))
+        plt.setp(self.ax.get_xticklabels(), rotation=45, ha='right',
+                 fontsize=9, color='#34495e')
+        plt.setp(self.ax.get_yticklabels(), fontsize=9, color='#34495e')
+
+        # Every full redraw (including resizes) refreshes the background
+        self.background = None
+        self.canvas.mpl_connect('draw_event', self.on_draw)
+
+        self.root.after(PLOT_INTERVAL_MS, self.update_plot)
+
+    def on_draw(self, event):  # pylint: disable=unused-argument
+        """Cache the static part of the plot and draw the line on top"""
+        self.background = self.canvas.copy_from_bbox(self.ax.bbox)
+        self.ax.draw_artist(self.temp_line)
+
+    def relimit(self, t_first, t_last, temp_min, temp_max):
+        """Move the axes only once the data leaves them.
+
+        Returns True when a full redraw is needed. The X axis jumps ahead by
+        a quarter of the visible span, so most frames only blit the line.
+        """
+        moved = False
+
+        x_min, x_max = self.ax.get_xlim()
+        if t_last > x_max or t_first < x_min:
+            headroom = max((t_last - t_first) * 0.25, 1.0)
+            self.ax.set_xlim(t_first, t_last + headroom)
+            moved = True
+
+        y_min, y_max = self.ax.get_ylim()
+        if temp_min < y_min or temp_max > y_max:
+            # Nice round limits with some padding
+            padding = max((temp_max - temp_min) * 0.15, 2)
+            self.ax.set_ylim(int((temp_min - padding) / 5) * 5,
+                             int((temp_max + padding) / 5 + 1) * 5)
+            moved = True
 
         try:
-            # Read current sampling period from driver
-            with open('/sys/class/misc/simtemp/sampling_ms',
-                      'r', encoding='utf-8') as f:
-                sampling_ms = int(f.read().strip())
-
-            # Only update if significantly changed (avoid unnecessary restarts)
-            if abs(sampling_ms - self.current_sampling_ms) > 2:
-                self.current_sampling_ms = sampling_ms
-
-                # Calculate optimal update interval
-                # Strategy: Match sampling rate or use reasonable multiple
-                if sampling_ms <= 10:
-                    # Very fast sampling: update at sampling rate (max 100 FPS)
-                    self.adaptive_interval = sampling_ms
-                elif sampling_ms <= 33:
-                    # Medium sampling: match 1:1 for smoothness
-                    self.adaptive_interval = sampling_ms
-                elif sampling_ms <= 100:
-                    # Slower sampling: update at 2x rate for interpolation
-                    # smoothness
-                    self.adaptive_interval = sampling_ms // 2
-                else:
-                    # Very slow sampling: cap at 10 FPS
-                    self.adaptive_interval = max(sampling_ms // 3, 100)
-
-                # Restart animation with new interval
-                self.anim.event_source.interval = self.adaptive_interval
-
-                # Log the adaptation (for debugging)
-                print(
-                    f"🎯 Adapted: sampling={sampling_ms}ms → update={
-                        self.adaptive_interval}ms ({
-                        1000 // self.adaptive_interval} FPS)")
-
-        except (IOError, ValueError):
-            # Silently fail - driver might not be ready
+            threshold = float(self.threshold_c.get())
+            if self.threshold_line.get_ydata()[0] != threshold:
+                self.threshold_line.set_ydata([threshold, threshold])
+                moved = True
+        except (ValueError, tk.TclError):
             pass
 
-    # pylint: disable=too-many-locals,too-many-branches,too-many-statements
-    # Animation function requires comprehensive data processing
-    def update_plot(self, frame):  # pylint: disable=unused-argument
-        """Update the temperature plot with ultra-smooth interpolated rendering"""
-        self.update_counter += 1
+        return moved
 
-        # Periodically check and adapt frame rate
-        self.check_and_adapt_framerate()
+    def update_plot(self):
+        """Redraw the temperature line from the decimated plot history"""
+        self.root.after(PLOT_INTERVAL_MS, self.update_plot)
 
-        # Quick exit if no data
-        if len(self.timestamps) < 2:
+        # One min/max pair per horizontal pixel is all that can be seen
+        width = max(int(self.ax.bbox.width), 1)
+        data = self.plot_ring.decimate(width)
+        if data is None:
             return
 
         try:
-            # Make thread-safe copies efficiently
-            timestamps_copy = list(self.timestamps)
-            temperatures_copy = list(self.temperatures)
+            x, y, t_first, t_last = data
+            self.temp_line.set_data(x, y)
 
-            if not timestamps_copy or len(timestamps_copy) < 2:
+            if (self.relimit(t_first, t_last, float(y.min()), float(y.max()))
+                    or self.background is None):
+                # on_draw() caches the new background and adds the line
+                self.canvas.draw()
                 return
 
-            # Convert timestamps to relative seconds (time since monitoring started)
-            # Use the first recorded timestamp as reference, not the oldest in
-            # the deque
-            if self.start_timestamp is not None:
-                start_time = self.start_timestamp
-            else:
-                # Fallback if start_timestamp not set yet
-                start_time = timestamps_copy[0]
-
-            plot_times = [(ts - start_time).total_seconds()
-                          for ts in timestamps_copy]
-
-            # Apply smooth interpolation for fluid animation
-            if len(temperatures_copy) >= 4:
-                # Use numpy for smooth cubic interpolation
-
-                # Create smooth curve with 3x more points
-                t_array = np.array(plot_times)
-                temp_array = np.array(temperatures_copy)
-
-                # Use cubic spline for smooth interpolation
-                try:
-                    # Create more intermediate points for smoothness
-                    num_points = min(len(plot_times) * 3, 300)
-                    t_smooth = np.linspace(
-                        t_array.min(), t_array.max(), num_points)
-
-                    # B-spline for smooth curve (k=3 for cubic)
-                    spl = make_interp_spline(
-                        t_array, temp_array, k=min(
-                            3, len(t_array) - 1))
-                    temp_smooth = spl(t_smooth)
-
-                    # Update line with smooth data
-                    self.temp_line.set_data(t_smooth, temp_smooth)
-                except (ValueError, TypeError):
-                    # Fallback to original data if interpolation fails
-                    self.temp_line.set_data(plot_times, temperatures_copy)
-            else:
-                # Not enough points for interpolation, use raw data
-                self.temp_line.set_data(plot_times, temperatures_copy)
-
-            # Update threshold line (only if changed)
-            try:
-                threshold = float(self.threshold_c.get())
-                self.threshold_line.set_ydata([threshold, threshold])
-            except (ValueError, tk.TclError):
-                pass
-
-            # Calculate axis limits
-            temp_min = min(temperatures_copy)
-            temp_max = max(temperatures_copy)
-            temp_range = temp_max - temp_min
-
-            # Smart Y-axis limits with nice round numbers
-            if temp_range > 0:
-                padding = max(temp_range * 0.15, 2)
-                y_min = int((temp_min - padding) / 5) * 5
-                y_max = int((temp_max + padding) / 5 + 1) * 5
-            else:
-                y_min = int(temp_min / 5) * 5 - 5
-                y_max = int(temp_max / 5) * 5 + 5
-
-            x_min = min(plot_times)
-            x_max = max(plot_times)
-
-            # Only update axes if limits changed significantly (reduces
-            # flicker)
-            new_xlim = (x_min, x_max)
-            new_ylim = (y_min, y_max)
-
-            if self.last_xlim != new_xlim:
-                self.ax.set_xlim(x_min, x_max)
-                self.last_xlim = new_xlim
-
-            if self.last_ylim != new_ylim:
-                self.ax.set_ylim(y_min, y_max)
-                self.last_ylim = new_ylim
-
-            # Update time formatting only every 4th frame (reduces overhead)
-            if self.update_counter % 4 == 0:
-                # Format X-axis to show seconds with nice intervals
-                # pylint: disable=import-outside-toplevel
-                from matplotlib.ticker import MaxNLocator
-                self.ax.xaxis.set_major_locator(
-                    MaxNLocator(nbins=8, integer=True))
-                self.ax.xaxis.set_major_formatter(
-                    plt.FuncFormatter(lambda x, p: f'{int(x)}s'))
-
-                # Efficient label styling (only when updating)
-                plt.setp(self.ax.get_xticklabels(), rotation=45, ha='right',
-                         fontsize=9, color='#34495e')
-                plt.setp(
-                    self.ax.get_yticklabels(),
-                    fontsize=9,
-                    color='#34495e')
-
-            # Use flush_events for ultra-smooth updates
-            self.canvas.draw_idle()
-            self.canvas.flush_events()
+            self.canvas.restore_region(self.background)
+            self.ax.draw_artist(self.temp_line)
+            self.canvas.blit(self.ax.bbox)
 
         except (ValueError, AttributeError, RuntimeError) as e:
             # Handle plot update errors to prevent crashes
             print(f"Plot update error: {e}")
 
-    def get_optimal_update_interval(self):
-        """Calculate optimal GUI update interval based on driver sampling period"""
-        try:
-            # Read current sampling period from driver
-            sampling_ms = int(self.device.get_sysfs_value("sampling_ms"))
-            self.current_sampling_ms = sampling_ms
-
-            # Strategy: GUI updates at same rate or slightly faster for smoothness
-            # If sampling is very fast (<50ms), use 30 FPS to save CPU
-            # If sampling is slow (>50ms), match it exactly for 1:1
-            # correspondence
-
-            if sampling_ms <= 33:
-                # Fast sampling: cap at 30 FPS (33ms) to save CPU
-                interval = 33
-            elif sampling_ms <= 100:
-                # Medium sampling: use sampling rate or 30 FPS, whichever is
-                # faster
-                interval = min(sampling_ms, 33)
-            else:
-                # Slow sampling: match exactly for smooth 1:1 updates
-                interval = sampling_ms
-
-            print(
-                f"📊 Sampling period: {sampling_ms}ms → GUI update: {interval}ms ({
-                    1000 // interval} FPS)")
-            return interval
-
-        except (OSError, ValueError, AttributeError) as e:
-            print(
-                f"Warning: Could not read sampling period ({e}), using 33ms default")
-            return 33  # Default to 30 FPS
-
     def start_monitoring(self):
         """Start temperature monitoring"""
         if not os.path.exists(self.device.device_path):
@@ -693,18 +611,7 @@ class SimtempGUI:
         self.device.flush_buffer()
 
         # Reset timestamp reference
-        self.start_timestamp = None
-
-        # Calculate optimal update interval based on current sampling rate
-        optimal_interval = self.get_optimal_update_interval()
-
-        # Restart animation with new interval if it changed
-        if hasattr(
-                self,
-                'anim') and optimal_interval != self.gui_update_interval:
-            self.gui_update_interval = optimal_interval
-            self.anim.event_source.interval = optimal_interval
-            print(f"✅ Animation interval updated to {optimal_interval}ms")
+        self.start_ns = None
 
         self.monitoring = True
         self.start_button.config(state=tk.DISABLED)
@@ -725,26 +632,38 @@ class SimtempGUI:
             self.device.close()
 
     def monitor_worker(self):
-        """Worker thread for monitoring temperature"""
+        """Worker thread: bulk reads into the plot history"""
         sample_count = 0
         alert_count = 0
 
         while self.monitoring:
             try:
-                result = self.device.read_sample(timeout=0.5)
-                if result is None:
+                samples = self.device.read_samples(READ_BATCH, timeout=0.5)
+                if samples is None or len(samples) == 0:
                     continue
 
-                timestamp, temp_c, flags = result
-                sample_count += 1
+                # Set start timestamp reference on first sample
+                if self.start_ns is None:
+                    self.start_ns = int(samples[0]['timestamp_ns'])
+                    print(f"📍 Time reference set: "
+                          f"{datetime.fromtimestamp(self.start_ns / 1e9)}")
+
+                times = (samples['timestamp_ns'].astype(np.int64) -
+                         self.start_ns) / 1e9
+                temps = samples['temp_mC'] / 1000.0
+                alerts = int(np.count_nonzero(
+                    samples['flags'] & SIMTEMP_FLAG_THRESHOLD_CROSSED))
+
+                self.plot_ring.extend(times, temps)
+                sample_count += len(samples)
 
                 # Update current values
-                self.current_temp.set(f"{temp_c:.1f}°C")
+                self.current_temp.set(f"{temps[-1]:.1f}°C")
                 self.sample_count.set(str(sample_count))
 
                 # Check for alert with dynamic color coding
-                if flags & SIMTEMP_FLAG_THRESHOLD_CROSSED:
-                    alert_count += 1
+                if alerts:
+                    alert_count += alerts
                     self.current_alert.set("⚠️ YES")
                     self.alert_count.set(str(alert_count))
                     # Change alert display color to red
@@ -760,17 +679,6 @@ class SimtempGUI:
                         0, lambda: self.alert_display.config(
                             foreground="#27ae60"))
 
-                # Set start timestamp reference on first sample
-                if self.start_timestamp is None:
-                    self.start_timestamp = timestamp
-                    print(f"📍 Time reference set: {timestamp}")
-
-                # Add to data collections
-                self.timestamps.append(timestamp)
-                self.temperatures.append(temp_c)
-                self.alerts.append(
-                    bool(flags & SIMTEMP_FLAG_THRESHOLD_CROSSED))
-
             except (OSError, ValueError, RuntimeError) as e:
                 print(f"Monitor error: {e}")
                 break
@@ -787,9 +695,8 @@ class SimtempGUI:
 
     def clear_data(self):
         """Clear collected data"""
-        self.timestamps.clear()
-        self.temperatures.clear()
-        self.alerts.clear()
+        self.plot_ring.clear()
+        self.start_ns = None
         self.sample_count.set("0")
         self.alert_count.set("0")
         self.current_temp.set("--.-°C")
@@ -843,11 +750,6 @@ class SimtempGUI:
             if self.device.set_sampling_period(period):
                 messagebox.showinfo(
                     "Success", f"Sampling period set to {period} ms")
-                # Immediately adapt frame rate to new sampling period
-                # Force check by resetting last check time
-                self.last_sampling_check = datetime.now() - \
-                    timedelta(seconds=10)
-                self.check_and_adapt_framerate()
             else:
                 messagebox.showerror("Error", "Failed to set sampling period")
         except ValueError: